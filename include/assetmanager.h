@@ -0,0 +1,264 @@
+#ifndef ASSETMANAGER_H
+#define ASSETMANAGER_H
+
+#include "gl-color-normal-position-vertex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads assets in the background. A job runs on one of the worker threads
+// and does the file I/O and decoding, what it returns is the GL part of the
+// load. Those uploads wait in a bounded queue until the GL thread runs them
+// from DrainUploads(), a few per frame, so loading never stalls a frame for
+// long. Workers block while the upload queue is full, which keeps the memory
+// of decoded but not yet uploaded assets in check.
+class AssetManager
+{
+public:
+    // Runs on the GL thread
+    typedef std::function<void()> Upload;
+
+    // Runs on a worker thread and returns the upload, or an empty one when
+    // there is nothing to upload
+    typedef std::function<Upload()> Job;
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _jobAvailable;
+    std::condition_variable _uploadSpace;
+    std::deque<Job> _jobs;
+    std::deque<Upload> _uploads;
+    size_t _uploadCapacity;
+    int _pending; // queued, loading or waiting for upload
+    bool _stopping;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _jobAvailable.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+                if (_stopping)
+                {
+                    return;
+                }
+
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+
+            auto upload = job();
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _uploadSpace.wait(lock, [this]() { return _stopping || _uploads.size() < _uploadCapacity; });
+                if (_stopping)
+                {
+                    return;
+                }
+
+                _uploads.push_back(std::move(upload));
+            }
+        }
+    }
+
+public:
+    AssetManager(size_t uploadCapacity = 16)
+        : _uploadCapacity(std::max(size_t(1), uploadCapacity)), _pending(0), _stopping(false)
+    {}
+
+    virtual ~AssetManager()
+    {
+        Stop();
+    }
+
+    // A workerCount of 0 leaves one core for the GL thread
+    void Start(int workerCount = 0)
+    {
+        if (!_workers.empty())
+        {
+            return;
+        }
+
+        if (workerCount <= 0)
+        {
+            workerCount = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+        }
+
+        _stopping = false;
+        for (int i = 0; i < workerCount; i++)
+        {
+            _workers.push_back(std::thread([this]() { workerLoop(); }));
+        }
+    }
+
+    // Waits for the jobs that are running, the ones still queued and the
+    // uploads that did not run yet are dropped
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _jobAvailable.notify_all();
+        _uploadSpace.notify_all();
+
+        for (auto &worker : _workers)
+        {
+            worker.join();
+        }
+        _workers.clear();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.clear();
+        _uploads.clear();
+        _pending = 0;
+    }
+
+    // Without workers the job runs right away, only its upload is deferred
+    void Load(Job job)
+    {
+        if (_workers.empty())
+        {
+            auto upload = job();
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _uploads.push_back(std::move(upload));
+            _pending++;
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+            _pending++;
+        }
+        _jobAvailable.notify_one();
+    }
+
+#ifdef TINY_OBJ_LOADER_H_
+
+    // The buffer must not be touched until ready is called, or until its
+    // vertexArrayId() is set when there is no callback. Both happen on the GL
+    // thread inside DrainUploads().
+    void LoadMesh(BufferType &buffer, std::string const &filename, std::string const &materialPath, std::string const &shapeName,
+                  VertexFormat format, ShaderType const *shader, std::function<void()> ready = nullptr)
+    {
+        LoadMesh(buffer, std::make_shared<ObjModel>(filename, materialPath, ObjParseMode::Parallel, 1), shapeName, format, shader, ready);
+    }
+
+    // Loads more shapes of one OBJ while parsing it once, whichever job gets
+    // to the model first parses it and the others wait for that. The model
+    // parses on one thread, the workers already keep the other cores busy
+    // and a parse per core on each of them would start cores squared threads.
+    void LoadMesh(BufferType &buffer, std::shared_ptr<ObjModel> const &model, std::string const &shapeName,
+                  VertexFormat format, ShaderType const *shader, std::function<void()> ready = nullptr)
+    {
+        auto target = &buffer;
+
+        model->SetThreadCount(1);
+
+        Load([=]() -> Upload {
+            target->loadObj(*model, shapeName)
+                .format(format)
+                .prepare();
+
+            return [=]() {
+                target->setup(shader);
+                if (ready)
+                {
+                    ready();
+                }
+            };
+        });
+    }
+
+#endif
+
+#ifdef TINY_GLTF_LOADER_H_
+
+    // Same as LoadMesh() for one primitive of a mesh in a binary glTF file
+    void LoadGlb(BufferType &buffer, std::string const &filename, std::string const &meshName,
+                 ShaderType const *shader, std::function<void()> ready = nullptr)
+    {
+        auto target = &buffer;
+
+        Load([=]() -> Upload {
+            target->loadGlb(filename, meshName);
+
+            return [=]() {
+                target->setup(shader);
+                if (ready)
+                {
+                    ready();
+                }
+            };
+        });
+    }
+
+#endif
+
+    // Call once per frame on the GL thread. Runs uploads until the budget is
+    // used up, at least one so loading always moves on. Returns how many ran.
+    int DrainUploads(double budgetMs)
+    {
+        typedef std::chrono::high_resolution_clock Clock;
+
+        auto start = Clock::now();
+        int count = 0;
+
+        for (;;)
+        {
+            Upload upload;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_uploads.empty())
+                {
+                    break;
+                }
+
+                upload = std::move(_uploads.front());
+                _uploads.pop_front();
+            }
+            _uploadSpace.notify_one();
+
+            if (upload)
+            {
+                upload();
+            }
+            count++;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _pending--;
+            }
+
+            if (std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= budgetMs)
+            {
+                break;
+            }
+        }
+
+        return count;
+    }
+
+    int PendingCount()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        return _pending;
+    }
+};
+
+#endif // ASSETMANAGER_H
@@ -0,0 +1,151 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+struct Aabb
+{
+    glm::vec3 _min;
+    glm::vec3 _max;
+};
+
+// View frustum for culling world space bounding boxes. The planes are taken
+// from a projection * view matrix and point inwards, a box is culled when it
+// is completely behind any of them.
+class Frustum
+{
+    // The six planes stored per component and padded to eight, so the SSE
+    // path can test four planes at once
+    float _nx[8], _ny[8], _nz[8], _d[8];
+
+    void setPlane(int index, glm::vec4 const &plane)
+    {
+        auto length = glm::length(glm::vec3(plane));
+        if (length > 0.0f)
+        {
+            length = 1.0f / length;
+        }
+
+        _nx[index] = plane.x * length;
+        _ny[index] = plane.y * length;
+        _nz[index] = plane.z * length;
+        _d[index] = plane.w * length;
+    }
+
+public:
+    static const int PlaneCount = 6;
+
+    Frustum()
+    {
+        Extract(glm::mat4(1.0f));
+    }
+
+    explicit Frustum(glm::mat4 const &projectionView)
+    {
+        Extract(projectionView);
+    }
+
+    void Extract(glm::mat4 const &m)
+    {
+        // glm is column major, m[column][row]
+        auto row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+        auto row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+        auto row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+        auto row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        setPlane(0, row3 + row0); // left
+        setPlane(1, row3 - row0); // right
+        setPlane(2, row3 + row1); // bottom
+        setPlane(3, row3 - row1); // top
+        setPlane(4, row3 + row2); // near
+        setPlane(5, row3 - row2); // far
+
+        // The padding planes accept everything
+        for (int i = 6; i < 8; i++)
+        {
+            _nx[i] = _ny[i] = _nz[i] = 0.0f;
+            _d[i] = 1.0f;
+        }
+    }
+
+    // Normalized plane, xyz is the inward normal and w the distance
+    glm::vec4 Plane(int index) const
+    {
+        return glm::vec4(_nx[index], _ny[index], _nz[index], _d[index]);
+    }
+
+    bool IntersectsAabb(glm::vec3 const &min, glm::vec3 const &max) const
+    {
+        auto center = (min + max) * 0.5f;
+        auto extent = (max - min) * 0.5f;
+
+#ifdef FRUSTUM_USE_SSE
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+        const __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+
+        for (int i = 0; i < 8; i += 4)
+        {
+            __m128 nx = _mm_loadu_ps(&_nx[i]);
+            __m128 ny = _mm_loadu_ps(&_ny[i]);
+            __m128 nz = _mm_loadu_ps(&_nz[i]);
+
+            // Signed distance of the center and the box radius along each normal
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz, cz), _mm_loadu_ps(&_d[i])));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                                                  _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())) != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+#else
+        for (int i = 0; i < 6; i++)
+        {
+            auto distance = _nx[i] * center.x + _ny[i] * center.y + _nz[i] * center.z + _d[i];
+            auto radius = std::fabs(_nx[i]) * extent.x + std::fabs(_ny[i]) * extent.y + std::fabs(_nz[i]) * extent.z;
+
+            if (distance + radius < 0.0f)
+            {
+                return false;
+            }
+        }
+
+        return true;
+#endif
+    }
+
+    bool IntersectsAabb(Aabb const &box) const
+    {
+        return IntersectsAabb(box._min, box._max);
+    }
+
+    // Bounds of a local space box after transforming it with model
+    static Aabb TransformAabb(glm::mat4 const &model, Aabb const &box)
+    {
+        auto center = glm::vec3(model * glm::vec4((box._min + box._max) * 0.5f, 1.0f));
+        auto extent = (box._max - box._min) * 0.5f;
+
+        glm::vec3 radius(0.0f);
+        for (int column = 0; column < 3; column++)
+        {
+            radius += glm::abs(glm::vec3(model[column])) * extent[column];
+        }
+
+        return {center - radius, center + radius};
+    }
+};
+
+#endif // FRUSTUM_H
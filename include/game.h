@@ -1,6 +1,7 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
@@ -37,11 +38,17 @@ class UserInput
     std::map<UserInputActions, bool> _actionStates;
     std::map<UserInputEvent, UserInputActions> _stateMapping;
 
-public:
-    bool _mappingMode;
+    // StartMappingAction() is called from the UI on the GL thread while
+    // ProcessEvent() runs on the simulation thread, _actionToMap is only
+    // touched under the mappings mutex and set before the flag is published
+    std::atomic<bool> _mappingMode;
     UserInputActions _actionToMap;
 
+public:
+    UserInput();
+
     void StartMappingAction(UserInputActions action);
+    void MapAction(UserInputEvent const &event, UserInputActions action);
     std::vector<UserInputEvent> GetMappedActionEvents(UserInputActions action);
 
     void ProcessEvent(UserInputEvent const &event, bool state);
@@ -57,7 +64,10 @@ class Game
 public:
     virtual ~Game() {}
 
+    // Setup() needs a window and GL context and calls SetupSimulation() itself,
+    // SetupSimulation() only builds the game world and is all a headless run needs
     virtual bool Setup() = 0;
+    virtual bool SetupSimulation() = 0;
     virtual void Resize(int width, int height) = 0;
     virtual void Update(int dt) = 0;
     virtual void Render() = 0;
@@ -1,14 +1,25 @@
 #ifndef GLCOLORNORMALPOSITIONVERTEX_H
 #define GLCOLORNORMALPOSITIONVERTEX_H
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+#include "gl-frame-uniforms.h"
+#include "meshcache.h"
 #include <fstream>
 #include <glad/glad.h>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
+#ifdef TINY_OBJ_LOADER_H_
+#include "objmodel.h"
+#endif
+
 #if TRUE
 
 #include <glm/glm.hpp>
@@ -262,6 +273,135 @@ public:
     glm::vec3 nor;
 };
 
+// Hashes and compares vertices bit for bit, to find duplicates when building
+// an index buffer
+struct VertexTypeHash
+{
+    size_t operator()(VertexType const &v) const
+    {
+        float values[10] = {v.pos.x, v.pos.y, v.pos.z, v.col.r, v.col.g, v.col.b, v.col.a, v.nor.x, v.nor.y, v.nor.z};
+
+        size_t hash = 14695981039346656037ULL;
+        for (int i = 0; i < 10; i++)
+        {
+            unsigned int bits;
+            memcpy(&bits, &values[i], sizeof(bits));
+            hash = (hash ^ bits) * 1099511628211ULL;
+        }
+
+        return hash;
+    }
+};
+
+struct VertexTypeEqual
+{
+    bool operator()(VertexType const &a, VertexType const &b) const
+    {
+        return memcmp(&a, &b, sizeof(VertexType)) == 0;
+    }
+};
+
+// Layouts a BufferType can upload its vertices in. Float is the plain 40 byte
+// VertexType, the packed ones store color as RGBA8 and the normal as 10:10:10:2
+enum class VertexFormat
+{
+    Float,      // 40 bytes
+    Packed,     // 20 bytes, float position
+    PackedHalf, // 16 bytes, half float position
+    External,   // whatever the loaded file uses, see BufferType::loadGltf()
+};
+
+enum class VertexAttribute
+{
+    Position,
+    Color,
+    Normal,
+};
+
+// Where one attribute is in the vertex buffer, for the External format
+struct VertexAttributeLayout
+{
+    GLint _size;
+    GLenum _type;
+    GLboolean _normalized;
+    GLsizei _stride;
+    size_t _offset;
+};
+
+class PackedVertexType
+{
+public:
+    glm::vec3 pos;
+    unsigned int col;
+    unsigned int nor;
+};
+
+class PackedHalfVertexType
+{
+public:
+    unsigned short pos[4]; // the 4th is padding to keep the rest 4 byte aligned
+    unsigned int col;
+    unsigned int nor;
+};
+
+namespace VertexPacking {
+
+inline unsigned int packColor(glm::vec4 const &color)
+{
+    auto channel = [](float v) -> unsigned int {
+        return (unsigned int)(std::fmin(std::fmax(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+    };
+
+    // Red ends up in the lowest byte, so it is the first one in memory
+    return channel(color.r) | (channel(color.g) << 8) | (channel(color.b) << 16) | (channel(color.a) << 24);
+}
+
+// Matches GL_INT_2_10_10_10_REV, x in the lowest 10 bits and w left at 0
+inline unsigned int packNormal(glm::vec3 const &normal)
+{
+    auto component = [](float v) -> unsigned int {
+        return (unsigned int)(int)std::round(std::fmin(std::fmax(v, -1.0f), 1.0f) * 511.0f) & 0x3ff;
+    };
+
+    return component(normal.x) | (component(normal.y) << 10) | (component(normal.z) << 20);
+}
+
+inline unsigned short packHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0)
+    {
+        // Too small for a normal half, mesh positions never need the subnormals
+        return (unsigned short)sign;
+    }
+
+    if (exponent >= 31)
+    {
+        return (unsigned short)(sign | 0x7c00);
+    }
+
+    // Round to nearest, a carry into the exponent is still the right value
+    return (unsigned short)(sign | ((unsigned int)(exponent << 10) + ((mantissa + 0x1000) >> 13)));
+}
+
+inline PackedVertexType pack(VertexType const &vertex)
+{
+    return {vertex.pos, packColor(vertex.col), packNormal(vertex.nor)};
+}
+
+inline PackedHalfVertexType packHalf(VertexType const &vertex)
+{
+    return {{packHalf(vertex.pos.x), packHalf(vertex.pos.y), packHalf(vertex.pos.z), 0}, packColor(vertex.col), packNormal(vertex.nor)};
+}
+
+} // namespace VertexPacking
+
 class ShaderType
 {
     GLuint _shaderId;
@@ -276,12 +416,65 @@ class ShaderType
     std::string _vertexAttributeName;
     std::string _colorAttributeName;
     std::string _normalAttributeName;
+    std::string _instanceModelAttributeName;
+
+    bool _usesFrameUniforms;
+
+    // The default shaders only differ in where the model matrix comes from
+    static std::string defaultVertexShader(bool instanced)
+    {
+        std::string const modelInput(instanced ? "in mat4 instanceModel;\n" : "uniform mat4 u_model;\n");
+        std::string const modelSource(instanced ? "instanceModel" : "u_model");
+
+        return std::string(
+                   "#version 150\n"
+
+                   "in vec3 vertex;\n"
+                   "in vec4 color;\n"
+                   "in vec3 normal;\n") +
+               FrameUniformBuffer::blockSource() +
+               modelInput +
+               "out vec4 f_color;\n"
+
+               "void main()\n"
+               "{\n"
+               "    mat4 model = " + modelSource + ";\n"
+               "    gl_Position = u_projection * u_view * model * vec4(vertex.xyz, 1.0);\n"
+               "    f_color = color;\n"
+
+               "    vec3 vertexPosition_cameraspace  = (u_view * model * vec4(vertex, 0)).xyz;\n"
+               "    vec3 EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;\n"
+               "    vec3 LightPosition_cameraspace = (u_view * vec4(-500.0, -500.0, 500.0,1)).xyz;\n"
+               "    vec3 LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;\n"
+               "    vec3 Normal_cameraspace = (u_view * model * vec4(normal, 0)).xyz;\n"
+               "    vec3 n = normalize( Normal_cameraspace );\n"
+               "    vec3 l = normalize( LightDirection_cameraspace );\n"
+               "    float cosTheta = clamp(dot(n, l), 0.3, 1);\n"
+
+               "    f_color = (cosTheta * color) + (color * vec4(0.8, 0.8, 0.8, 1.0));\n"
+               "}\n";
+    }
+
+    static std::string defaultFragmentShader()
+    {
+        return std::string(
+            "#version 150\n"
+
+            "in vec4 f_color;\n"
+            "out vec4 color;\n"
+
+            "void main()\n"
+            "{\n"
+            "   color = f_color;\n"
+            "}\n");
+    }
 
 public:
     ShaderType()
         : _shaderId(0), _projectionUniformId(0), _viewUniformId(0), _modelUniformId(0),
           _projectionUniformName("u_projection"), _viewUniformName("u_view"), _modelUniformName("u_model"),
-          _vertexAttributeName("vertex"), _colorAttributeName("color"), _normalAttributeName("normal")
+          _vertexAttributeName("vertex"), _colorAttributeName("color"), _normalAttributeName("normal"),
+          _instanceModelAttributeName("instanceModel"), _usesFrameUniforms(false)
     {}
 
     virtual ~ShaderType() {}
@@ -315,46 +508,8 @@ public:
 
         if (defaultShader == 0)
         {
-            std::string const vshader(
-                "#version 150\n"
-
-                "in vec3 vertex;\n"
-                "in vec4 color;\n"
-                "in vec3 normal;\n"
-
-                "uniform mat4 u_projection;\n"
-                "uniform mat4 u_view;\n"
-                "uniform mat4 u_model;\n"
-
-                "out vec4 f_color;\n"
-
-                "void main()\n"
-                "{\n"
-                "    gl_Position = u_projection * u_view * u_model * vec4(vertex.xyz, 1.0);\n"
-                "    f_color = color;\n"
-
-                "    vec3 vertexPosition_cameraspace  = (u_view * u_model * vec4(vertex, 0)).xyz;\n"
-                "    vec3 EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;\n"
-                "    vec3 LightPosition_cameraspace = (u_view * vec4(-500.0, -500.0, 500.0,1)).xyz;\n"
-                "    vec3 LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;\n"
-                "    vec3 Normal_cameraspace = (u_view * u_model * vec4(normal, 0)).xyz;\n"
-                "    vec3 n = normalize( Normal_cameraspace );\n"
-                "    vec3 l = normalize( LightDirection_cameraspace );\n"
-                "    float cosTheta = clamp(dot(n, l), 0.3, 1);\n"
-
-                "    f_color = (cosTheta * color) + (color * vec4(0.8, 0.8, 0.8, 1.0));\n"
-                "}\n");
-
-            std::string const fshader(
-                "#version 150\n"
-
-                "in vec4 f_color;\n"
-                "out vec4 color;\n"
-
-                "void main()\n"
-                "{\n"
-                "   color = f_color;\n"
-                "}\n");
+            std::string const vshader(defaultVertexShader(false));
+            std::string const fshader(defaultFragmentShader());
 
             if (compile(vshader, fshader))
             {
@@ -369,6 +524,13 @@ public:
         return true;
     }
 
+    // Same as the default shader, but the model matrix is a per instance
+    // attribute, see BufferType::setupInstances()
+    bool compileDefaultInstancedShader()
+    {
+        return compile(defaultVertexShader(true), defaultFragmentShader());
+    }
+
     virtual bool compile(std::string const &vertShaderStr, std::string const &fragShaderStr)
     {
         GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
@@ -433,60 +595,370 @@ public:
         _projectionUniformId = glGetUniformLocation(_shaderId, _projectionUniformName.c_str());
         _viewUniformId = glGetUniformLocation(_shaderId, _viewUniformName.c_str());
         _modelUniformId = glGetUniformLocation(_shaderId, _modelUniformName.c_str());
+        _usesFrameUniforms = FrameUniformBuffer::bindBlock(_shaderId);
 
         return true;
     }
 
+    bool usesFrameUniforms() const
+    {
+        return _usesFrameUniforms;
+    }
+
+    // Projection and view are only uploaded for shaders without the
+    // FrameUniforms block, the others get them from FrameUniformBuffer
     void setupMatrices(glm::mat4 const &projection, glm::mat4 const &view, glm::mat4 const &model)
     {
         use();
 
-        glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projection));
-        glUniformMatrix4fv(_viewUniformId, 1, false, glm::value_ptr(view));
+        if (!_usesFrameUniforms)
+        {
+            glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projection));
+            glUniformMatrix4fv(_viewUniformId, 1, false, glm::value_ptr(view));
+        }
         glUniformMatrix4fv(_modelUniformId, 1, false, glm::value_ptr(model));
     }
 
-    void setupMatrices(glm::mat4 const &projectionView, glm::mat4 const &model)
+    // Split versions of setupMatrices() for when the shader is already in use
+    // and the camera does not change between draws
+    void setupCamera(glm::mat4 const &projection, glm::mat4 const &view) const
     {
-        use();
+        if (_usesFrameUniforms)
+        {
+            return;
+        }
 
-        glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projectionView));
-        glUniformMatrix4fv(_modelUniformId, 1, false, glm::value_ptr(model));
+        glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projection));
+        glUniformMatrix4fv(_viewUniformId, 1, false, glm::value_ptr(view));
     }
 
-    void setupAttributes() const
+    void setupModel(glm::mat4 const &model) const
     {
-        auto vertexSize = sizeof(VertexType);
+        glUniformMatrix4fv(_modelUniformId, 1, false, glm::value_ptr(model));
+    }
 
+    void setupAttributes(VertexFormat format = VertexFormat::Float) const
+    {
         auto vertexAttrib = glGetAttribLocation(_shaderId, _vertexAttributeName.c_str());
-        glVertexAttribPointer(GLuint(vertexAttrib), sizeof(VertexType::pos) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, 0);
-        glEnableVertexAttribArray(GLuint(vertexAttrib));
-
         auto colorAttrib = glGetAttribLocation(_shaderId, _colorAttributeName.c_str());
-        glVertexAttribPointer(GLuint(colorAttrib), sizeof(VertexType::col) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid *>(sizeof(VertexType::pos)));
-        glEnableVertexAttribArray(GLuint(colorAttrib));
-
         auto normalAttrib = glGetAttribLocation(_shaderId, _normalAttributeName.c_str());
-        glVertexAttribPointer(GLuint(normalAttrib), sizeof(VertexType::nor) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid *>(sizeof(VertexType::pos) + sizeof(VertexType::col)));
+
+        switch (format)
+        {
+            case VertexFormat::Packed:
+            {
+                auto vertexSize = sizeof(PackedVertexType);
+
+                glVertexAttribPointer(GLuint(vertexAttrib), 3, GL_FLOAT, GL_FALSE, vertexSize, 0);
+                glVertexAttribPointer(GLuint(colorAttrib), 4, GL_UNSIGNED_BYTE, GL_TRUE, vertexSize, reinterpret_cast<const GLvoid *>(offsetof(PackedVertexType, col)));
+                glVertexAttribPointer(GLuint(normalAttrib), 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexSize, reinterpret_cast<const GLvoid *>(offsetof(PackedVertexType, nor)));
+                break;
+            }
+            case VertexFormat::PackedHalf:
+            {
+                auto vertexSize = sizeof(PackedHalfVertexType);
+
+                glVertexAttribPointer(GLuint(vertexAttrib), 3, GL_HALF_FLOAT, GL_FALSE, vertexSize, 0);
+                glVertexAttribPointer(GLuint(colorAttrib), 4, GL_UNSIGNED_BYTE, GL_TRUE, vertexSize, reinterpret_cast<const GLvoid *>(offsetof(PackedHalfVertexType, col)));
+                glVertexAttribPointer(GLuint(normalAttrib), 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexSize, reinterpret_cast<const GLvoid *>(offsetof(PackedHalfVertexType, nor)));
+                break;
+            }
+            default:
+            {
+                auto vertexSize = sizeof(VertexType);
+
+                glVertexAttribPointer(GLuint(vertexAttrib), sizeof(VertexType::pos) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, 0);
+                glVertexAttribPointer(GLuint(colorAttrib), sizeof(VertexType::col) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid *>(sizeof(VertexType::pos)));
+                glVertexAttribPointer(GLuint(normalAttrib), sizeof(VertexType::nor) / sizeof(float), GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<const GLvoid *>(sizeof(VertexType::pos) + sizeof(VertexType::col)));
+                break;
+            }
+        }
+
+        glEnableVertexAttribArray(GLuint(vertexAttrib));
+        glEnableVertexAttribArray(GLuint(colorAttrib));
         glEnableVertexAttribArray(GLuint(normalAttrib));
     }
+
+    // For vertex data that is not in one of the VertexFormat layouts
+    void setupAttribute(VertexAttribute attribute, VertexAttributeLayout const &layout) const
+    {
+        std::string const *name = &_vertexAttributeName;
+        if (attribute == VertexAttribute::Color)
+        {
+            name = &_colorAttributeName;
+        }
+        else if (attribute == VertexAttribute::Normal)
+        {
+            name = &_normalAttributeName;
+        }
+
+        auto attrib = glGetAttribLocation(_shaderId, name->c_str());
+        if (attrib < 0)
+        {
+            return;
+        }
+
+        glVertexAttribPointer(GLuint(attrib), layout._size, layout._type, layout._normalized, layout._stride, reinterpret_cast<const GLvoid *>(layout._offset));
+        glEnableVertexAttribArray(GLuint(attrib));
+    }
+
+    // Expects the instance buffer to be bound, a mat4 attribute takes four
+    // vec4 slots which all advance once per instance
+    void setupInstanceAttributes() const
+    {
+        auto modelAttrib = glGetAttribLocation(_shaderId, _instanceModelAttributeName.c_str());
+        if (modelAttrib < 0)
+        {
+            return;
+        }
+
+        for (GLuint column = 0; column < 4; column++)
+        {
+            auto attrib = GLuint(modelAttrib) + column;
+
+            glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<const GLvoid *>(column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(attrib);
+            glVertexAttribDivisor(attrib, 1);
+        }
+    }
 };
 
+#ifdef TINY_GLTF_LOADER_H_
+
+namespace GltfAccess {
+
+// Bytes per component, 0 for types GL can not read as vertex data
+inline size_t componentSize(int componentType)
+{
+    switch (componentType)
+    {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return 1;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return 2;
+        case TINYGLTF_COMPONENT_TYPE_INT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// Components per element, 0 for the matrix types
+inline int componentCount(int type)
+{
+    switch (type)
+    {
+        case TINYGLTF_TYPE_SCALAR:
+            return 1;
+        case TINYGLTF_TYPE_VEC2:
+            return 2;
+        case TINYGLTF_TYPE_VEC3:
+            return 3;
+        case TINYGLTF_TYPE_VEC4:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// One component as GL reads it without normalizing
+inline float component(unsigned char const *data, int componentType)
+{
+    switch (componentType)
+    {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return float(*reinterpret_cast<signed char const *>(data));
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return float(*data);
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        {
+            int16_t value;
+            memcpy(&value, data, sizeof(value));
+            return float(value);
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            memcpy(&value, data, sizeof(value));
+            return float(value);
+        }
+        case TINYGLTF_COMPONENT_TYPE_INT:
+        {
+            int32_t value;
+            memcpy(&value, data, sizeof(value));
+            return float(value);
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        {
+            uint32_t value;
+            memcpy(&value, data, sizeof(value));
+            return float(value);
+        }
+        default:
+        {
+            float value;
+            memcpy(&value, data, sizeof(value));
+            return value;
+        }
+    }
+}
+
+inline size_t elementSize(tinygltf::Accessor const &accessor)
+{
+    return componentSize(accessor.componentType) * size_t(componentCount(accessor.type));
+}
+
+// Returns nullptr when the accessor does not exist, has a type GL can not
+// read, or reaches outside of its buffer view or buffer
+inline tinygltf::Accessor const *find(tinygltf::Model const &model, int index)
+{
+    if (index < 0 || size_t(index) >= model.accessors.size())
+    {
+        return nullptr;
+    }
+
+    auto const &accessor = model.accessors[size_t(index)];
+    if (accessor.bufferView < 0 || size_t(accessor.bufferView) >= model.bufferViews.size() || elementSize(accessor) == 0)
+    {
+        return nullptr;
+    }
+
+    auto const &view = model.bufferViews[size_t(accessor.bufferView)];
+    if (view.buffer < 0 || size_t(view.buffer) >= model.buffers.size() ||
+        view.byteOffset + view.byteLength > model.buffers[size_t(view.buffer)].data.size())
+    {
+        return nullptr;
+    }
+
+    auto size = elementSize(accessor);
+    auto stride = view.byteStride != 0 ? view.byteStride : size;
+    if (accessor.count > 0 && accessor.byteOffset + stride * (accessor.count - 1) + size > view.byteLength)
+    {
+        return nullptr;
+    }
+
+    return &accessor;
+}
+
+inline tinygltf::Accessor const *find(tinygltf::Model const &model, tinygltf::Primitive const &primitive, std::string const &attribute)
+{
+    auto found = primitive.attributes.find(attribute);
+
+    return found != primitive.attributes.end() ? find(model, found->second) : nullptr;
+}
+
+inline unsigned char const *data(tinygltf::Model const &model, tinygltf::Accessor const &accessor)
+{
+    auto const &view = model.bufferViews[size_t(accessor.bufferView)];
+
+    return model.buffers[size_t(view.buffer)].data.data() + view.byteOffset + accessor.byteOffset;
+}
+
+} // namespace GltfAccess
+
+#endif
+
 class BufferType
 {
     int _vertexCount;
+    int _indexCount;
     std::vector<VertexType> _verts;
+    std::vector<unsigned int> _indices;
     glm::vec4 _nextColor;
     glm::vec3 _nextNormal;
     unsigned int _vertexArrayId;
     unsigned int _vertexBufferId;
+    unsigned int _indexBufferId;
+    unsigned int _instanceBufferId;
+    int _instanceCount;
+    glm::vec3 _boundsMin;
+    glm::vec3 _boundsMax;
     GLenum _drawMode;
-    std::map<int, int> _faces;
+    VertexFormat _format;
+    // Face ranges, kept as separate arrays so they can go to glMultiDraw* as is.
+    // With an index buffer the ranges are into the indices.
+    std::vector<GLint> _faceStarts;
+    std::vector<GLsizei> _faceCounts;
+    std::vector<const GLvoid *> _faceOffsets;
+
+    // Set by loadObj() when it finds a valid baked mesh, setup() then uploads
+    // from the mapped file instead of _verts and _indices
+    std::shared_ptr<MeshCacheFile> _cache;
+
+    // Vertex data in the upload format, filled by prepare()
+    std::vector<unsigned char> _packedVertices;
+    bool _prepared;
+
+    // With the External format setup() copies these pieces of memory into
+    // the buffers as they are, the vertex ones at their offset
+    struct UploadRange
+    {
+        void const *_data;
+        size_t _size;
+        size_t _offset;
+    };
+
+    std::vector<UploadRange> _vertexRanges;
+    UploadRange _indexRange;
+    VertexAttributeLayout _attributeLayouts[3]; // by VertexAttribute
+    GLenum _indexType;
+    // Owns the memory the ranges point into, until setup()
+    std::shared_ptr<void const> _sourceOwner;
+
+    void sourceData(VertexType const *&verts, size_t &vertexCount, unsigned int const *&indices, size_t &indexCount) const
+    {
+        if (_cache != nullptr)
+        {
+            verts = static_cast<VertexType const *>(_cache->Vertices());
+            vertexCount = _cache->VertexCount();
+            indices = _cache->Indices();
+            indexCount = _cache->IndexCount();
+        }
+        else
+        {
+            verts = _verts.data();
+            vertexCount = _verts.size();
+            indices = _indices.data();
+            indexCount = _indices.size();
+        }
+    }
+
+    // Copies a mapped mesh into _verts and _indices, so edits after a cached
+    // loadObj() work the same as after one that parsed the OBJ
+    void detachCache()
+    {
+        if (_cache == nullptr)
+        {
+            return;
+        }
+
+        auto verts = static_cast<VertexType const *>(_cache->Vertices());
+        _verts.assign(verts, verts + _cache->VertexCount());
+        _indices.assign(_cache->Indices(), _cache->Indices() + _cache->IndexCount());
+        _cache.reset();
+        _prepared = false;
+    }
+
+    template <class T, class PackFunction>
+    void packVertices(VertexType const *verts, size_t count, PackFunction pack)
+    {
+        _packedVertices.resize(count * sizeof(T));
+        auto packed = reinterpret_cast<T *>(_packedVertices.data());
+        for (size_t i = 0; i < count; i++)
+        {
+            packed[i] = pack(verts[i]);
+        }
+    }
 
 public:
     BufferType()
-        : _vertexCount(0), _vertexArrayId(0), _vertexBufferId(0), _drawMode(GL_TRIANGLES),
-          _nextColor(glm::vec4(1.0f))
+        : _vertexCount(0), _indexCount(0), _vertexArrayId(0), _vertexBufferId(0), _indexBufferId(0), _instanceBufferId(0), _instanceCount(0),
+          _boundsMin(0.0f), _boundsMax(0.0f), _drawMode(GL_TRIANGLES), _format(VertexFormat::Float), _prepared(false),
+          _indexRange(), _attributeLayouts(), _indexType(GL_UNSIGNED_INT), _nextColor(glm::vec4(1.0f))
     {}
 
     virtual ~BufferType() {}
@@ -509,8 +981,15 @@ public:
             return false;
         }
 
+        prepare();
+
+        VertexType const *verts;
+        size_t vertexCount;
+        unsigned int const *indices;
+        size_t indexCount;
+        sourceData(verts, vertexCount, indices, indexCount);
+
         _drawMode = mode;
-        _vertexCount = _verts.size();
 
         glGenVertexArrays(1, &_vertexArrayId);
         glGenBuffers(1, &_vertexBufferId);
@@ -518,44 +997,266 @@ public:
         glBindVertexArray(_vertexArrayId);
         glBindBuffer(GL_ARRAY_BUFFER, _vertexBufferId);
 
-        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(_verts.size() * sizeof(VertexType)), 0, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(_verts.size() * sizeof(VertexType)), reinterpret_cast<const GLvoid *>(&_verts[0]));
+        if (_format == VertexFormat::External)
+        {
+            size_t size = 0;
+            for (auto const &range : _vertexRanges)
+            {
+                size = std::max(size, range._offset + range._size);
+            }
+
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(size), nullptr, GL_STATIC_DRAW);
+            for (auto const &range : _vertexRanges)
+            {
+                glBufferSubData(GL_ARRAY_BUFFER, GLintptr(range._offset), GLsizeiptr(range._size), range._data);
+            }
+        }
+        else if (_format == VertexFormat::Float)
+        {
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexCount * sizeof(VertexType)), reinterpret_cast<const GLvoid *>(verts), GL_STATIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(_packedVertices.size()), reinterpret_cast<const GLvoid *>(_packedVertices.data()), GL_STATIC_DRAW);
+        }
 
-        shader->setupAttributes();
+        // The element buffer binding is part of the vertex array state
+        if (_format == VertexFormat::External && _indexRange._size > 0)
+        {
+            glGenBuffers(1, &_indexBufferId);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBufferId);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(_indexRange._size), _indexRange._data, GL_STATIC_DRAW);
+        }
+        else if (_format != VertexFormat::External && indexCount > 0)
+        {
+            glGenBuffers(1, &_indexBufferId);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBufferId);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexCount * sizeof(unsigned int)), reinterpret_cast<const GLvoid *>(indices), GL_STATIC_DRAW);
+        }
+
+        if (_format == VertexFormat::External)
+        {
+            shader->setupAttribute(VertexAttribute::Position, _attributeLayouts[int(VertexAttribute::Position)]);
+            shader->setupAttribute(VertexAttribute::Color, _attributeLayouts[int(VertexAttribute::Color)]);
+            shader->setupAttribute(VertexAttribute::Normal, _attributeLayouts[int(VertexAttribute::Normal)]);
+        }
+        else
+        {
+            shader->setupAttributes(_format);
+        }
 
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
         _verts.clear();
+        _indices.clear();
+        _cache.reset();
+        std::vector<unsigned char>().swap(_packedVertices);
+        _prepared = false;
+        _vertexRanges.clear();
+        _indexRange = UploadRange();
+        _sourceOwner.reset();
 
         return true;
     }
 
+    // The part of setup() that needs no GL context: takes the counts and
+    // bounds and packs the vertices into the upload format. Can run on a
+    // loader thread, setup() calls it when that did not happen.
+    BufferType &prepare()
+    {
+        // loadGltf() already took the counts and bounds from the file
+        if (_prepared || _format == VertexFormat::External)
+        {
+            return *this;
+        }
+
+        VertexType const *verts;
+        size_t vertexCount;
+        unsigned int const *indices;
+        size_t indexCount;
+        sourceData(verts, vertexCount, indices, indexCount);
+
+        _vertexCount = int(vertexCount);
+        _indexCount = int(indexCount);
+
+        // Keep the local bounds around for culling, the vertices are gone after setup()
+        if (vertexCount > 0)
+        {
+            _boundsMin = _boundsMax = verts[0].pos;
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                _boundsMin = glm::min(_boundsMin, verts[i].pos);
+                _boundsMax = glm::max(_boundsMax, verts[i].pos);
+            }
+        }
+
+        // Vertices are always built as VertexType and only packed for the upload
+        switch (_format)
+        {
+            case VertexFormat::Packed:
+            {
+                packVertices<PackedVertexType>(verts, vertexCount, [](VertexType const &v) { return VertexPacking::pack(v); });
+                break;
+            }
+            case VertexFormat::PackedHalf:
+            {
+                packVertices<PackedHalfVertexType>(verts, vertexCount, [](VertexType const &v) { return VertexPacking::packHalf(v); });
+                break;
+            }
+            default:
+                break;
+        }
+
+        _prepared = true;
+
+        return *this;
+    }
+
     void render()
     {
         glBindVertexArray(_vertexArrayId);
-        if (_faces.empty())
+        draw();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    unsigned int vertexArrayId() const
+    {
+        return _vertexArrayId;
+    }
+
+    // Local space bounds of the vertices, known after setup()
+    glm::vec3 const &boundsMin() const
+    {
+        return _boundsMin;
+    }
+
+    glm::vec3 const &boundsMax() const
+    {
+        return _boundsMax;
+    }
+
+    // Like render(), but leaves binding the vertex array to the caller
+    void draw() const
+    {
+        if (_indexCount > 0 && _faceCounts.empty())
+        {
+            glDrawElements(_drawMode, _indexCount, _indexType, 0);
+        }
+        else if (_indexCount > 0)
+        {
+            glMultiDrawElements(_drawMode, &_faceCounts[0], _indexType, &_faceOffsets[0], GLsizei(_faceCounts.size()));
+        }
+        else if (_faceCounts.empty())
         {
             glDrawArrays(_drawMode, 0, _vertexCount);
         }
         else
         {
-            for (auto pair : _faces)
-            {
-                glDrawArrays(_drawMode, pair.first, pair.second);
-            }
+            glMultiDrawArrays(_drawMode, &_faceStarts[0], &_faceCounts[0], GLsizei(_faceCounts.size()));
+        }
+    }
+
+    // Adds a per instance model matrix buffer to an already setup buffer. The
+    // shader needs an instanceModel attribute, like the one from
+    // ShaderType::compileDefaultInstancedShader()
+    bool setupInstances(ShaderType const *shader)
+    {
+        if (shader == nullptr || _vertexArrayId == 0 || _instanceBufferId != 0)
+        {
+            return false;
         }
+
+        glGenBuffers(1, &_instanceBufferId);
+
+        glBindVertexArray(_vertexArrayId);
+        glBindBuffer(GL_ARRAY_BUFFER, _instanceBufferId);
+
+        shader->setupInstanceAttributes();
+
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return true;
+    }
+
+    // Replaces all instance matrices, meant to be called every frame
+    void updateInstances(std::vector<glm::mat4> const &matrices)
+    {
+        _instanceCount = matrices.size();
+
+        if (_instanceBufferId == 0 || matrices.empty())
+        {
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, _instanceBufferId);
+        // Orphan the old storage so the driver does not wait for the last frame
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(matrices.size() * sizeof(glm::mat4)), 0, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(matrices.size() * sizeof(glm::mat4)), reinterpret_cast<const GLvoid *>(&matrices[0]));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    int instanceCount() const
+    {
+        return _instanceCount;
+    }
+
+    // Draws the whole buffer once per instance, face ranges are ignored here
+    void renderInstanced()
+    {
+        if (_instanceCount <= 0)
+        {
+            return;
+        }
+
+        glBindVertexArray(_vertexArrayId);
+        drawInstanced();
+        glBindVertexArray(0);
+    }
+
+    void drawInstanced() const
+    {
+        if (_indexCount > 0)
+        {
+            glDrawElementsInstanced(_drawMode, _indexCount, _indexType, 0, _instanceCount);
+        }
+        else
+        {
+            glDrawArraysInstanced(_drawMode, 0, _vertexCount, _instanceCount);
+        }
     }
 
     void cleanup()
     {
+        if (_instanceBufferId != 0)
+        {
+            glDeleteBuffers(1, &_instanceBufferId);
+            _instanceBufferId = 0;
+        }
+        _instanceCount = 0;
         if (_vertexBufferId != 0)
         {
             glDeleteBuffers(1, &_vertexBufferId);
             _vertexBufferId = 0;
         }
+        if (_indexBufferId != 0)
+        {
+            glDeleteBuffers(1, &_indexBufferId);
+            _indexBufferId = 0;
+        }
+        _indexCount = 0;
+        _indexType = GL_UNSIGNED_INT;
+        if (_format == VertexFormat::External)
+        {
+            // Whatever is built in the buffer next uses the usual layouts
+            _format = VertexFormat::Float;
+            _vertexRanges.clear();
+            _indexRange = UploadRange();
+            _sourceOwner.reset();
+        }
         if (_vertexArrayId != 0)
         {
             glDeleteVertexArrays(1, &_vertexArrayId);
@@ -565,11 +1266,37 @@ public:
 
     std::vector<VertexType> &verts()
     {
+        detachCache();
+
         return _verts;
     }
 
+    // When there are indices, render() draws with them instead of the plain
+    // vertex order
+    std::vector<unsigned int> &indices()
+    {
+        detachCache();
+
+        return _indices;
+    }
+
+    BufferType &index(unsigned int i)
+    {
+        detachCache();
+        _indices.push_back(i);
+        _indexCount = _indices.size();
+
+        return *this;
+    }
+
+    int indexCount() const
+    {
+        return _indexCount;
+    }
+
     BufferType &operator<<(VertexType const &vertex)
     {
+        detachCache();
         _verts.push_back(vertex);
         _vertexCount = _verts.size();
 
@@ -581,9 +1308,32 @@ public:
         _drawMode = mode;
     }
 
+    // Pick before setup(), the format is baked into the vertex buffer. A
+    // buffer loaded with loadGltf() keeps the layout of its file, for it
+    // this does nothing.
+    BufferType &format(VertexFormat format)
+    {
+        if (_format == VertexFormat::External || format == VertexFormat::External)
+        {
+            return *this;
+        }
+
+        _format = format;
+        _prepared = false;
+
+        return *this;
+    }
+
+    VertexFormat format() const
+    {
+        return _format;
+    }
+
     void addFace(int start, int count)
     {
-        _faces.insert(std::make_pair(start, count));
+        _faceStarts.push_back(start);
+        _faceCounts.push_back(count);
+        _faceOffsets.push_back(reinterpret_cast<const GLvoid *>(start * sizeof(unsigned int)));
     }
 
     int vertexCount() const
@@ -593,6 +1343,7 @@ public:
 
     BufferType &vertex(glm::vec3 const &position)
     {
+        detachCache();
         _verts.push_back(VertexType({position, _nextColor, _nextNormal}));
 
         _vertexCount = _verts.size();
@@ -696,6 +1447,7 @@ public:
 
     BufferType &scale(glm::vec3 const &amount)
     {
+        detachCache();
         for (VertexType &v : _verts)
         {
             v.pos *= amount;
@@ -706,6 +1458,7 @@ public:
 
     BufferType &move(glm::vec3 const &amount)
     {
+        detachCache();
         for (VertexType &v : _verts)
         {
             v.pos += amount;
@@ -716,6 +1469,7 @@ public:
 
     BufferType &fillColor(glm::vec4 const &color)
     {
+        detachCache();
         for (VertexType &v : _verts)
         {
             v.col = color;
@@ -728,66 +1482,357 @@ public:
 
     BufferType &loadObj(std::string const &filename, std::string const &materialPath, std::string const &shapeName)
     {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string err;
+        ObjModel model(filename, materialPath);
+
+        return loadObj(model, shapeName);
+    }
+
+    // The first load of a shape bakes it into <filename>.<shapeName>.mesh next
+    // to the OBJ, later loads map that file instead of parsing the OBJ again.
+    // The cache is only used for a buffer that is still empty, and only while
+    // the OBJ, its .mtl files, the material path and the current color are
+    // the same as when it was written. The model is parsed on a cache miss
+    // only, so loading several shapes from one model parses the file at most
+    // once. Editing the buffer after a cache hit, with scale(), move() and
+    // the like, copies the mapped mesh into the buffer first.
+    BufferType &loadObj(ObjModel &model, std::string const &shapeName)
+    {
+        auto cacheFilename = model.Filename() + "." + shapeName + ".mesh";
+        MeshCacheStamp stamp;
+        bool useCache = _verts.empty() && _indices.empty() && _cache == nullptr && MeshCacheFile::Stamp(model.Filename(), stamp);
+
+        // Faces without a material get the current color
+        auto settings = MeshCacheFile::Checksum(model.MaterialPath().data(), model.MaterialPath().size());
+        settings = MeshCacheFile::Checksum(&_nextColor[0], sizeof(float) * 4, settings);
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str(), materialPath.c_str()))
+        if (useCache)
         {
-            std::cerr << "LoadObj failed" << std::endl;
+            auto cache = std::make_shared<MeshCacheFile>();
+            if (cache->Open(cacheFilename, sizeof(VertexType), stamp, settings))
+            {
+                _cache = cache;
+                _vertexCount = cache->VertexCount();
+                _indexCount = cache->IndexCount();
+
+                return *this;
+            }
+        }
+
+        if (!model.Parse())
+        {
+            return *this;
+        }
+
+        auto const &attrib = model.Attrib();
+        auto const &materials = model.Materials();
+        auto const *shape = model.FindShape(shapeName);
+
+        if (shape == nullptr)
+        {
+            std::cerr << "no shape \"" << shapeName << "\" in \"" << model.Filename() << "\"" << std::endl;
+
+            return *this;
+        }
+
+        // Face corners that share position, normal and color become one vertex
+        std::unordered_map<VertexType, unsigned int, VertexTypeHash, VertexTypeEqual> uniqueVertices;
+
+        // Loop over faces(polygon)
+        size_t index_offset = 0;
+        int faceCount = shape->mesh.num_face_vertices.size();
+        for (int f = 0; f < faceCount; f++)
+        {
+            if (materials.size() > 0 && shape->mesh.material_ids[f] >= 0)
+            {
+                // per-face material
+                auto m = materials[shape->mesh.material_ids[f]];
+
+                this->color(glm::vec4(m.diffuse[0], m.diffuse[1], m.diffuse[2], 1.0f));
+            }
+
+            int fv = shape->mesh.num_face_vertices[f];
+
+            // Loop over vertices in the face.
+            for (size_t v = 0; v < fv; v++)
+            {
+                // access to vertex
+                tinyobj::index_t idx = shape->mesh.indices[index_offset + v];
+                tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
+                tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
+                tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
+                tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
+                tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
+                tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
+                // tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
+                // tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+                // Optional: vertex colors
+                // tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
+                // tinyobj::real_t green = attrib.colors[3*idx.vertex_index+1];
+                // tinyobj::real_t blue = attrib.colors[3*idx.vertex_index+2];
+
+                VertexType vertex = {glm::vec3(vx, vy, vz), _nextColor, glm::vec3(nx, ny, nz)};
+
+                auto found = uniqueVertices.find(vertex);
+                if (found == uniqueVertices.end())
+                {
+                    found = uniqueVertices.insert(std::make_pair(vertex, (unsigned int)_verts.size())).first;
+                    _verts.push_back(vertex);
+                    _vertexCount = _verts.size();
+                }
+
+                this->index(found->second);
+            }
+            index_offset += fv;
+        }
+
+        if (useCache && !_verts.empty())
+        {
+            MeshCacheFile::Write(cacheFilename, sizeof(VertexType), _verts.data(), uint32_t(_verts.size()), _indices.data(), uint32_t(_indices.size()), stamp,
+                                 model.MaterialFiles(), settings);
+        }
+
+        return *this;
+    }
+
+#endif
+
+#ifdef TINY_GLTF_LOADER_H_
+
+    // Loads one primitive of a glTF mesh into an empty buffer. The vertex
+    // data stays in the layout of the file: setup() copies the buffer views
+    // it uses into the vertex buffer as they are and points the attributes
+    // at them, so nothing is unpacked or packed per vertex. A missing color
+    // is the material's base color, or the current color, and a missing
+    // normal faces +z. The buffer holds on to the model until setup(). Node
+    // transforms are not applied.
+    BufferType &loadGltf(std::shared_ptr<tinygltf::Model const> const &model, std::string const &meshName, size_t primitiveIndex = 0)
+    {
+        tinygltf::Primitive const *primitive = nullptr;
+        for (auto const &mesh : model->meshes)
+        {
+            if (mesh.name == meshName && primitiveIndex < mesh.primitives.size())
+            {
+                primitive = &mesh.primitives[primitiveIndex];
+                break;
+            }
+        }
+
+        if (primitive == nullptr)
+        {
+            std::cerr << "no mesh \"" << meshName << "\" with a primitive " << primitiveIndex << std::endl;
 
             return *this;
         }
 
-        for (size_t s = 0; s < shapes.size(); s++)
+        auto position = GltfAccess::find(*model, *primitive, "POSITION");
+        if (position == nullptr || GltfAccess::componentCount(position->type) != 3 || position->count == 0)
+        {
+            std::cerr << "mesh \"" << meshName << "\" has no usable positions" << std::endl;
+
+            return *this;
+        }
+
+        // Attributes that do not fit are left out and filled in like missing ones
+        auto normal = GltfAccess::find(*model, *primitive, "NORMAL");
+        if (normal != nullptr && (GltfAccess::componentCount(normal->type) != 3 || normal->count != position->count))
+        {
+            normal = nullptr;
+        }
+
+        auto color = GltfAccess::find(*model, *primitive, "COLOR_0");
+        if (color != nullptr && (GltfAccess::componentCount(color->type) < 3 || color->count != position->count))
+        {
+            color = nullptr;
+        }
+
+        // Element indices have to be tightly packed unsigned integers
+        tinygltf::Accessor const *indices = nullptr;
+        if (primitive->indices >= 0)
+        {
+            indices = GltfAccess::find(*model, primitive->indices);
+
+            bool usable = indices != nullptr &&
+                          GltfAccess::componentCount(indices->type) == 1 &&
+                          (indices->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE ||
+                           indices->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ||
+                           indices->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+
+            if (usable)
+            {
+                auto stride = model->bufferViews[size_t(indices->bufferView)].byteStride;
+                usable = stride == 0 || stride == GltfAccess::elementSize(*indices);
+            }
+
+            if (!usable)
+            {
+                std::cerr << "mesh \"" << meshName << "\" has indices that can not go to GL as they are" << std::endl;
+
+                return *this;
+            }
+        }
+
+        _vertexRanges.clear();
+        _packedVertices.clear();
+
+        // Each buffer view goes into the vertex buffer once, even when more
+        // attributes are interleaved in it. Offsets stay 4 byte aligned.
+        std::map<int, size_t> viewOffsets;
+        size_t end = 0;
+
+        auto addRange = [&](void const *data, size_t size) {
+            size_t offset = (end + 3) & ~size_t(3);
+            _vertexRanges.push_back({data, size, offset});
+            end = offset + size;
+
+            return offset;
+        };
+
+        auto addAttribute = [&](VertexAttribute attribute, tinygltf::Accessor const &accessor) {
+            auto const &view = model->bufferViews[size_t(accessor.bufferView)];
+
+            auto found = viewOffsets.find(accessor.bufferView);
+            if (found == viewOffsets.end())
+            {
+                auto offset = addRange(model->buffers[size_t(view.buffer)].data.data() + view.byteOffset, view.byteLength);
+                found = viewOffsets.insert(std::make_pair(accessor.bufferView, offset)).first;
+            }
+
+            auto &layout = _attributeLayouts[int(attribute)];
+            layout._size = GLint(GltfAccess::componentCount(accessor.type));
+            layout._type = GLenum(accessor.componentType);
+            // Integer colors and normals are stored normalized, see the glTF spec
+            layout._normalized = (attribute != VertexAttribute::Position && accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) ? GL_TRUE : GL_FALSE;
+            layout._stride = GLsizei(view.byteStride);
+            layout._offset = found->second + accessor.byteOffset;
+        };
+
+        addAttribute(VertexAttribute::Position, *position);
+
+        if (normal != nullptr)
+        {
+            addAttribute(VertexAttribute::Normal, *normal);
+        }
+
+        if (color != nullptr)
         {
-            if (shapes[s].name == shapeName)
+            addAttribute(VertexAttribute::Color, *color);
+        }
+
+        // The missing attributes are the only vertex data built here
+        auto count = position->count;
+        size_t fillFloats = (color == nullptr ? 4 : 0) + (normal == nullptr ? 3 : 0);
+        _packedVertices.resize(count * fillFloats * sizeof(float));
+        auto fill = reinterpret_cast<float *>(_packedVertices.data());
+
+        if (color == nullptr)
+        {
+            glm::vec4 fillColor = _nextColor;
+            if (primitive->material >= 0 && size_t(primitive->material) < model->materials.size())
             {
-                // Loop over faces(polygon)
-                size_t index_offset = 0;
-                int faceCount = shapes[s].mesh.num_face_vertices.size();
-                for (int f = 0; f < faceCount; f++)
+                auto const &values = model->materials[size_t(primitive->material)].values;
+                auto factor = values.find("baseColorFactor");
+                if (factor != values.end() && factor->second.number_array.size() == 4)
                 {
-                    if (materials.size() > 0 && shapes[s].mesh.material_ids[f] >= 0)
-                    {
-                        // per-face material
-                        auto m = materials[shapes[s].mesh.material_ids[f]];
-
-                        this->color(glm::vec4(m.diffuse[0], m.diffuse[1], m.diffuse[2], 1.0f));
-                    }
-
-                    int fv = shapes[s].mesh.num_face_vertices[f];
-
-                    // Loop over vertices in the face.
-                    for (size_t v = 0; v < fv; v++)
-                    {
-                        // access to vertex
-                        tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                        tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-                        tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-                        tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-                        tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-                        tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-                        tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-                        // tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                        // tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-                        // Optional: vertex colors
-                        // tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
-                        // tinyobj::real_t green = attrib.colors[3*idx.vertex_index+1];
-                        // tinyobj::real_t blue = attrib.colors[3*idx.vertex_index+2];
-
-                        this->normal(glm::vec3(nx, ny, nz))
-                            .vertex(glm::vec3(vx, vy, vz));
-                    }
-                    index_offset += fv;
+                    auto const &rgba = factor->second.number_array;
+                    fillColor = glm::vec4(float(rgba[0]), float(rgba[1]), float(rgba[2]), float(rgba[3]));
                 }
             }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                fill[i * 4 + 0] = fillColor.r;
+                fill[i * 4 + 1] = fillColor.g;
+                fill[i * 4 + 2] = fillColor.b;
+                fill[i * 4 + 3] = fillColor.a;
+            }
+
+            _attributeLayouts[int(VertexAttribute::Color)] = {4, GL_FLOAT, GL_FALSE, 0, addRange(fill, count * 4 * sizeof(float))};
+            fill += count * 4;
+        }
+
+        if (normal == nullptr)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                fill[i * 3 + 0] = 0.0f;
+                fill[i * 3 + 1] = 0.0f;
+                fill[i * 3 + 2] = 1.0f;
+            }
+
+            _attributeLayouts[int(VertexAttribute::Normal)] = {3, GL_FLOAT, GL_FALSE, 0, addRange(fill, count * 3 * sizeof(float))};
+        }
+
+        _indexRange = UploadRange();
+        _indexType = GL_UNSIGNED_INT;
+        _indexCount = 0;
+        if (indices != nullptr)
+        {
+            _indexRange._data = GltfAccess::data(*model, *indices);
+            _indexRange._size = indices->count * GltfAccess::elementSize(*indices);
+            _indexType = GLenum(indices->componentType);
+            _indexCount = int(indices->count);
+        }
+
+        // POSITION is required to have its bounds in the file, only look at
+        // the data when a file leaves them out
+        if (position->minValues.size() == 3 && position->maxValues.size() == 3)
+        {
+            _boundsMin = glm::vec3(float(position->minValues[0]), float(position->minValues[1]), float(position->minValues[2]));
+            _boundsMax = glm::vec3(float(position->maxValues[0]), float(position->maxValues[1]), float(position->maxValues[2]));
+        }
+        else
+        {
+            auto size = GltfAccess::componentSize(position->componentType);
+            auto stride = model->bufferViews[size_t(position->bufferView)].byteStride;
+            stride = stride != 0 ? stride : 3 * size;
+
+            // Integer positions are not normalized, see addAttribute()
+            auto data = GltfAccess::data(*model, *position);
+            for (size_t i = 0; i < count; i++)
+            {
+                auto element = data + i * stride;
+                glm::vec3 pos(GltfAccess::component(element, position->componentType),
+                              GltfAccess::component(element + size, position->componentType),
+                              GltfAccess::component(element + 2 * size, position->componentType));
+
+                _boundsMin = i == 0 ? pos : glm::min(_boundsMin, pos);
+                _boundsMax = i == 0 ? pos : glm::max(_boundsMax, pos);
+            }
         }
 
+        _verts.clear();
+        _indices.clear();
+        _cache.reset();
+        _faceStarts.clear();
+        _faceCounts.clear();
+        _faceOffsets.clear();
+
+        _vertexCount = int(count);
+        _drawMode = GLenum(primitive->mode);
+        _format = VertexFormat::External;
+        _sourceOwner = model;
+
         return *this;
     }
 
+    // Reads a binary .glb file, to take more meshes from one file load the
+    // model once and hand it to loadGltf() for each of them
+    BufferType &loadGlb(std::string const &filename, std::string const &meshName, size_t primitiveIndex = 0)
+    {
+        auto model = std::make_shared<tinygltf::Model>();
+
+        tinygltf::TinyGLTFLoader loader;
+        std::string err;
+        if (!loader.LoadBinaryFromFile(model.get(), &err, filename, tinygltf::REQUIRE_ACCESSORS | tinygltf::REQUIRE_BUFFERS | tinygltf::REQUIRE_BUFFER_VIEWS))
+        {
+            std::cerr << "LoadBinaryFromFile failed for \"" << filename << "\": " << err << std::endl;
+
+            return *this;
+        }
+
+        return loadGltf(model, meshName, primitiveIndex);
+    }
+
 #endif
 };
 
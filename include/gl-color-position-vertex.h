@@ -2,7 +2,9 @@
 #define GLCOLORPOSITIONVERTEX_H
 
 #include <cmath>
+#include <cstring>
 #include <fstream>
+#include "gl-frame-uniforms.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -37,13 +39,15 @@ class ShaderType
     std::string _vertexAttributeName;
     std::string _colorAttributeName;
 
+    bool _usesFrameUniforms;
+
     static GLuint defaultShader;
 
 public:
     ShaderType()
         : _shaderId(0), _projectionUniformId(0), _viewUniformId(0), _modelUniformId(0), _colorUniformId(0),
           _projectionUniformName("u_projection"), _viewUniformName("u_view"), _modelUniformName("u_model"), _colorUniformName("u_color"),
-          _vertexAttributeName("vertex"), _colorAttributeName("color")
+          _vertexAttributeName("vertex"), _colorAttributeName("color"), _usesFrameUniforms(false)
     {}
 
     virtual ~ShaderType() {}
@@ -81,20 +85,20 @@ public:
             _viewUniformId = glGetUniformLocation(_shaderId, _viewUniformName.c_str());
             _modelUniformId = glGetUniformLocation(_shaderId, _modelUniformName.c_str());
             _colorUniformId = glGetUniformLocation(_shaderId, _colorUniformName.c_str());
+            _usesFrameUniforms = FrameUniformBuffer::bindBlock(_shaderId);
 
             return true;
         }
 
+        // Projection and view come from the FrameUniforms block
         std::string const vshader(
-            "#version 150\n"
+            std::string("#version 150\n"
 
-            "in vec3 vertex;"
-            "in vec4 color;"
-
-            "uniform mat4 u_projection;"
-            "uniform mat4 u_view;"
-            "uniform mat4 u_model;"
+                        "in vec3 vertex;"
+                        "in vec4 color;"
 
+                        "uniform mat4 u_model;\n") +
+            FrameUniformBuffer::blockSource() +
             "out vec4 f_color;"
 
             "void main()"
@@ -191,24 +195,27 @@ public:
         _viewUniformId = glGetUniformLocation(_shaderId, _viewUniformName.c_str());
         _modelUniformId = glGetUniformLocation(_shaderId, _modelUniformName.c_str());
         _colorUniformId = glGetUniformLocation(_shaderId, _colorUniformName.c_str());
+        _usesFrameUniforms = FrameUniformBuffer::bindBlock(_shaderId);
 
         return true;
     }
 
-    void setupMatrices(glm::mat4 const &projection, glm::mat4 const &view, glm::mat4 const &model)
+    bool usesFrameUniforms() const
     {
-        use();
-
-        glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projection));
-        glUniformMatrix4fv(_viewUniformId, 1, false, glm::value_ptr(view));
-        glUniformMatrix4fv(_modelUniformId, 1, false, glm::value_ptr(model));
+        return _usesFrameUniforms;
     }
 
-    void setupMatrices(glm::mat4 const &projectionView, glm::mat4 const &model)
+    // Projection and view are only uploaded for shaders without the
+    // FrameUniforms block, the others get them from FrameUniformBuffer
+    void setupMatrices(glm::mat4 const &projection, glm::mat4 const &view, glm::mat4 const &model)
     {
         use();
 
-        glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projectionView));
+        if (!_usesFrameUniforms)
+        {
+            glUniformMatrix4fv(_projectionUniformId, 1, false, glm::value_ptr(projection));
+            glUniformMatrix4fv(_viewUniformId, 1, false, glm::value_ptr(view));
+        }
         glUniformMatrix4fv(_modelUniformId, 1, false, glm::value_ptr(model));
     }
 
@@ -238,16 +245,23 @@ public:
 class BufferType
 {
     int _vertexCount;
+    int _firstVertex;
     std::vector<VertexType> _verts;
     glm::vec4 _nextColor;
     unsigned int _vertexArrayId;
     unsigned int _vertexBufferId;
     GLenum _drawMode;
-    std::map<int, int> _faces;
+    // Size of the streaming buffer and where the next stream() writes, both in vertices
+    int _streamCapacity;
+    int _streamOffset;
+    // Face ranges, kept as separate arrays so they can go to glMultiDrawArrays as is
+    std::vector<GLint> _faceStarts;
+    std::vector<GLsizei> _faceCounts;
 
 public:
     BufferType()
-        : _vertexCount(0), _vertexArrayId(0), _vertexBufferId(0), _drawMode(GL_TRIANGLES)
+        : _vertexCount(0), _firstVertex(0), _vertexArrayId(0), _vertexBufferId(0), _drawMode(GL_TRIANGLES),
+          _streamCapacity(0), _streamOffset(0)
     {}
 
     virtual ~BufferType() {}
@@ -286,19 +300,94 @@ public:
         return true;
     }
 
-    void render()
+    // Sets up an empty buffer for vertices that change every frame, fill it
+    // with stream() instead of building it with verts() and setup()
+    bool setupStreaming(ShaderType const *shader, int capacity)
     {
+        if (shader == nullptr || _vertexArrayId != 0 || _vertexBufferId != 0)
+        {
+            return false;
+        }
+
+        _streamCapacity = capacity > 0 ? capacity : 1;
+        _streamOffset = 0;
+        _firstVertex = 0;
+        _vertexCount = 0;
+
+        glGenVertexArrays(1, &_vertexArrayId);
+        glGenBuffers(1, &_vertexBufferId);
+
         glBindVertexArray(_vertexArrayId);
-        if (_faces.empty())
+        glBindBuffer(GL_ARRAY_BUFFER, _vertexBufferId);
+
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(_streamCapacity * sizeof(VertexType)), 0, GL_STREAM_DRAW);
+
+        shader->setupAttributes();
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return true;
+    }
+
+    // Writes the vertices behind the ones of earlier calls, so the GPU can
+    // still be drawing those. When the buffer is full its storage is orphaned
+    // and writing starts at the front again, when count does not fit at all
+    // the buffer grows.
+    void stream(VertexType const *verts, int count)
+    {
+        _firstVertex = 0;
+        _vertexCount = 0;
+
+        if (_vertexBufferId == 0 || count <= 0)
         {
-            glDrawArrays(_drawMode, 0, _vertexCount);
+            return;
         }
-        else
+
+        glBindBuffer(GL_ARRAY_BUFFER, _vertexBufferId);
+
+        if (_streamOffset + count > _streamCapacity)
         {
-            for (auto pair : _faces)
+            while (_streamCapacity < count)
             {
-                glDrawArrays(_drawMode, pair.first, pair.second);
+                _streamCapacity *= 2;
             }
+
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(_streamCapacity * sizeof(VertexType)), 0, GL_STREAM_DRAW);
+            _streamOffset = 0;
+        }
+
+        auto offset = GLintptr(_streamOffset * sizeof(VertexType));
+        auto size = GLsizeiptr(count * sizeof(VertexType));
+
+        auto target = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (target != nullptr)
+        {
+            memcpy(target, verts, size_t(size));
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        else
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, offset, size, reinterpret_cast<const GLvoid *>(verts));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        _firstVertex = _streamOffset;
+        _vertexCount = count;
+        _streamOffset += count;
+    }
+
+    void render()
+    {
+        glBindVertexArray(_vertexArrayId);
+        if (_faceCounts.empty())
+        {
+            glDrawArrays(_drawMode, _firstVertex, _vertexCount);
+        }
+        else
+        {
+            glMultiDrawArrays(_drawMode, &_faceStarts[0], &_faceCounts[0], GLsizei(_faceCounts.size()));
         }
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -316,6 +405,9 @@ public:
             glDeleteVertexArrays(1, &_vertexArrayId);
             _vertexArrayId = 0;
         }
+        _firstVertex = 0;
+        _streamCapacity = 0;
+        _streamOffset = 0;
     }
 
     std::vector<VertexType> &verts()
@@ -338,7 +430,8 @@ public:
 
     void addFace(int start, int count)
     {
-        _faces.insert(std::make_pair(start, count));
+        _faceStarts.push_back(start);
+        _faceCounts.push_back(count);
     }
 
     int vertexCount() const
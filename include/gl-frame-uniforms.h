@@ -0,0 +1,100 @@
+#ifndef GLFRAMEUNIFORMS_H
+#define GLFRAMEUNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+
+// Camera matrices for all shaders in one uniform buffer, uploaded once per
+// frame instead of for every draw. Shaders pick it up by declaring the block
+// from blockSource(), ShaderType::compile() binds it when it is there.
+class FrameUniformBuffer
+{
+    // Matches the std140 layout of the block, three mat4 need no padding
+    struct Uniforms
+    {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::mat4 projectionView;
+    };
+
+    GLuint _bufferId;
+
+public:
+    static const GLuint BindingPoint = 0;
+
+    static char const *blockName()
+    {
+        return "FrameUniforms";
+    }
+
+    static std::string blockSource()
+    {
+        return std::string(
+            "layout(std140) uniform FrameUniforms\n"
+            "{\n"
+            "    mat4 u_projection;\n"
+            "    mat4 u_view;\n"
+            "    mat4 u_projectionView;\n"
+            "};\n");
+    }
+
+    // Returns false when the program does not use the block
+    static bool bindBlock(GLuint program)
+    {
+        auto blockIndex = glGetUniformBlockIndex(program, blockName());
+        if (blockIndex == GL_INVALID_INDEX)
+        {
+            return false;
+        }
+
+        glUniformBlockBinding(program, blockIndex, BindingPoint);
+
+        return true;
+    }
+
+    FrameUniformBuffer()
+        : _bufferId(0)
+    {}
+
+    virtual ~FrameUniformBuffer() {}
+
+    bool setup()
+    {
+        if (_bufferId != 0)
+        {
+            return false;
+        }
+
+        glGenBuffers(1, &_bufferId);
+        glBindBuffer(GL_UNIFORM_BUFFER, _bufferId);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Uniforms), 0, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        return true;
+    }
+
+    // Call once per frame before drawing
+    void update(glm::mat4 const &projection, glm::mat4 const &view)
+    {
+        Uniforms uniforms = {projection, view, projection * view};
+
+        glBindBuffer(GL_UNIFORM_BUFFER, _bufferId);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Uniforms), &uniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, BindingPoint, _bufferId);
+    }
+
+    void cleanup()
+    {
+        if (_bufferId != 0)
+        {
+            glDeleteBuffers(1, &_bufferId);
+            _bufferId = 0;
+        }
+    }
+};
+
+#endif // GLFRAMEUNIFORMS_H
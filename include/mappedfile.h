@@ -0,0 +1,155 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only view of a whole file through the OS page cache. The data stays
+// valid until Close() or destruction.
+class MappedFile
+{
+#ifdef _WIN32
+    HANDLE _file;
+    HANDLE _mapping;
+#else
+    int _file;
+#endif
+    void const *_data;
+    size_t _size;
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+public:
+    MappedFile()
+#ifdef _WIN32
+        : _file(INVALID_HANDLE_VALUE), _mapping(nullptr), _data(nullptr), _size(0)
+#else
+        : _file(-1), _data(nullptr), _size(0)
+#endif
+    {}
+
+    virtual ~MappedFile()
+    {
+        Close();
+    }
+
+    bool Open(std::string const &filename)
+    {
+        Close();
+
+#ifdef _WIN32
+        _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        _size = size_t(size.QuadPart);
+
+        _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        _data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        _file = open(filename.c_str(), O_RDONLY);
+        if (_file < 0)
+        {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(_file, &info) != 0 || info.st_size == 0)
+        {
+            Close();
+            return false;
+        }
+        _size = size_t(info.st_size);
+
+        auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+        _data = (data == MAP_FAILED ? nullptr : data);
+#endif
+
+        if (_data == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (_data != nullptr)
+        {
+            UnmapViewOfFile(_data);
+        }
+        if (_mapping != nullptr)
+        {
+            CloseHandle(_mapping);
+            _mapping = nullptr;
+        }
+        if (_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(_file);
+            _file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (_data != nullptr)
+        {
+            munmap(const_cast<void *>(_data), _size);
+        }
+        if (_file >= 0)
+        {
+            close(_file);
+            _file = -1;
+        }
+#endif
+        _data = nullptr;
+        _size = 0;
+    }
+
+    bool IsOpen() const
+    {
+        return _data != nullptr;
+    }
+
+    void const *Data() const
+    {
+        return _data;
+    }
+
+    size_t Size() const
+    {
+        return _size;
+    }
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,298 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "mappedfile.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// Size and modification time of the file a cached mesh was baked from, a
+// cache file is only used while these still match
+struct MeshCacheStamp
+{
+    uint64_t _sourceSize;
+    int64_t _sourceTime;
+};
+
+// Baked mesh file: a header, the files the mesh was built from besides the
+// source, then the raw vertex and index data, ready to be handed to
+// glBufferData straight from the mapped file.
+//
+// The vertex data is stored as is, the vertex size in the header makes sure
+// a cache written with another vertex layout is not used. The settings hash
+// covers whatever else went into the vertices, like a default color.
+class MeshCacheFile
+{
+    struct Header
+    {
+        char _magic[4];
+        uint32_t _version;
+        uint32_t _vertexSize;
+        uint32_t _vertexCount;
+        uint32_t _indexCount;
+        uint32_t _dependencyCount;
+        uint32_t _dependencyBytes; // a multiple of 8 so the vertices stay aligned
+        uint32_t _reserved;
+        uint64_t _sourceSize;
+        int64_t _sourceTime;
+        uint64_t _settings;
+        uint64_t _checksum; // over the dependencies, the vertices, then the indices
+    };
+
+    // Followed by the file name, not terminated
+    struct Dependency
+    {
+        uint64_t _size;
+        int64_t _time;
+        uint32_t _nameLength;
+        uint32_t _reserved;
+    };
+
+    static const uint32_t Version = 2;
+
+    MappedFile _file;
+    Header const *_header;
+
+    // A dependency that does not exist has to stay missing
+    static MeshCacheStamp dependencyStamp(std::string const &filename)
+    {
+        MeshCacheStamp stamp;
+        if (!Stamp(filename, stamp))
+        {
+            stamp._sourceSize = 0;
+            stamp._sourceTime = -1;
+        }
+
+        return stamp;
+    }
+
+    static bool dependenciesMatch(unsigned char const *data, Header const *header)
+    {
+        size_t offset = 0;
+        for (uint32_t i = 0; i < header->_dependencyCount; i++)
+        {
+            Dependency dependency;
+            if (offset + sizeof(dependency) > header->_dependencyBytes)
+            {
+                return false;
+            }
+
+            memcpy(&dependency, data + offset, sizeof(dependency));
+            offset += sizeof(dependency);
+
+            if (offset + dependency._nameLength > header->_dependencyBytes)
+            {
+                return false;
+            }
+
+            auto name = std::string(reinterpret_cast<char const *>(data + offset), dependency._nameLength);
+            offset += dependency._nameLength;
+
+            auto stamp = dependencyStamp(name);
+            if (uint64_t(stamp._sourceSize) != dependency._size || stamp._sourceTime != dependency._time)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+public:
+    MeshCacheFile()
+        : _header(nullptr)
+    {}
+
+    static uint64_t Checksum(void const *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+    {
+        auto bytes = static_cast<unsigned char const *>(data);
+
+        // FNV-1a, eight bytes at a time and the rest byte by byte
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    static bool Stamp(std::string const &sourceFile, MeshCacheStamp &stamp)
+    {
+        struct stat info;
+        if (stat(sourceFile.c_str(), &info) != 0)
+        {
+            return false;
+        }
+
+        stamp._sourceSize = uint64_t(info.st_size);
+        stamp._sourceTime = int64_t(info.st_mtime);
+
+        return true;
+    }
+
+    // Maps the cache file and checks it belongs to stamp and settings, has
+    // the expected vertex size, none of its dependencies changed and it is
+    // not damaged
+    bool Open(std::string const &filename, uint32_t vertexSize, MeshCacheStamp const &stamp, uint64_t settings)
+    {
+        _header = nullptr;
+
+        if (!_file.Open(filename) || _file.Size() < sizeof(Header))
+        {
+            _file.Close();
+            return false;
+        }
+
+        auto header = static_cast<Header const *>(_file.Data());
+        auto dependencyBytes = uint64_t(header->_dependencyBytes);
+        auto vertexBytes = uint64_t(header->_vertexCount) * header->_vertexSize;
+        auto indexBytes = uint64_t(header->_indexCount) * sizeof(uint32_t);
+        auto dependencies = static_cast<unsigned char const *>(_file.Data()) + sizeof(Header);
+        auto vertices = dependencies + dependencyBytes;
+
+        if (memcmp(header->_magic, "ICYM", 4) != 0 ||
+            header->_version != Version ||
+            header->_vertexSize != vertexSize ||
+            header->_sourceSize != stamp._sourceSize ||
+            header->_sourceTime != stamp._sourceTime ||
+            header->_settings != settings ||
+            _file.Size() != sizeof(Header) + dependencyBytes + vertexBytes + indexBytes)
+        {
+            _file.Close();
+            return false;
+        }
+
+        auto hash = Checksum(dependencies, size_t(dependencyBytes));
+        hash = Checksum(vertices, size_t(vertexBytes), hash);
+        hash = Checksum(vertices + vertexBytes, size_t(indexBytes), hash);
+
+        if (hash != header->_checksum || !dependenciesMatch(dependencies, header))
+        {
+            _file.Close();
+            return false;
+        }
+
+        _header = header;
+
+        return true;
+    }
+
+    // The dependencies are stamped here, a later change to any of them, or
+    // one that did not exist showing up, makes Open() fail
+    static bool Write(std::string const &filename, uint32_t vertexSize, void const *vertices, uint32_t vertexCount,
+                      uint32_t const *indices, uint32_t indexCount, MeshCacheStamp const &stamp,
+                      std::vector<std::string> const &dependencyFiles, uint64_t settings)
+    {
+        std::vector<unsigned char> dependencies;
+        for (auto const &name : dependencyFiles)
+        {
+            auto dependencyStamp = MeshCacheFile::dependencyStamp(name);
+
+            Dependency dependency;
+            dependency._size = dependencyStamp._sourceSize;
+            dependency._time = dependencyStamp._sourceTime;
+            dependency._nameLength = uint32_t(name.size());
+            dependency._reserved = 0;
+
+            auto offset = dependencies.size();
+            dependencies.resize(offset + sizeof(dependency) + name.size());
+            memcpy(dependencies.data() + offset, &dependency, sizeof(dependency));
+            memcpy(dependencies.data() + offset + sizeof(dependency), name.data(), name.size());
+        }
+        dependencies.resize((dependencies.size() + 7) & ~size_t(7), 0);
+
+        Header header;
+        memcpy(header._magic, "ICYM", 4);
+        header._version = Version;
+        header._vertexSize = vertexSize;
+        header._vertexCount = vertexCount;
+        header._indexCount = indexCount;
+        header._dependencyCount = uint32_t(dependencyFiles.size());
+        header._dependencyBytes = uint32_t(dependencies.size());
+        header._reserved = 0;
+        header._sourceSize = stamp._sourceSize;
+        header._sourceTime = stamp._sourceTime;
+        header._settings = settings;
+
+        auto vertexBytes = size_t(vertexCount) * vertexSize;
+        auto indexBytes = size_t(indexCount) * sizeof(uint32_t);
+
+        header._checksum = Checksum(dependencies.data(), dependencies.size());
+        header._checksum = Checksum(vertices, vertexBytes, header._checksum);
+        header._checksum = Checksum(indices, indexBytes, header._checksum);
+
+        // Written next to the cache and renamed over it, so a process that has
+        // the old file mapped keeps its copy and a crash never leaves half a file
+        auto tempFilename = filename + ".tmp";
+        {
+            std::ofstream outfile(tempFilename, std::ios::binary | std::ios::trunc);
+            if (!outfile.is_open())
+            {
+                return false;
+            }
+
+            outfile.write(reinterpret_cast<char const *>(&header), sizeof(header));
+            outfile.write(reinterpret_cast<char const *>(dependencies.data()), std::streamsize(dependencies.size()));
+            outfile.write(static_cast<char const *>(vertices), std::streamsize(vertexBytes));
+            outfile.write(reinterpret_cast<char const *>(indices), std::streamsize(indexBytes));
+            outfile.close();
+
+            if (!outfile.good())
+            {
+                std::remove(tempFilename.c_str());
+                return false;
+            }
+        }
+
+#ifdef _WIN32
+        bool replaced = MoveFileExA(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        bool replaced = std::rename(tempFilename.c_str(), filename.c_str()) == 0;
+#endif
+        if (!replaced)
+        {
+            std::remove(tempFilename.c_str());
+        }
+
+        return replaced;
+    }
+
+    uint32_t VertexCount() const
+    {
+        return _header != nullptr ? _header->_vertexCount : 0;
+    }
+
+    uint32_t IndexCount() const
+    {
+        return _header != nullptr ? _header->_indexCount : 0;
+    }
+
+    void const *Vertices() const
+    {
+        return _header != nullptr ? reinterpret_cast<unsigned char const *>(_header + 1) + _header->_dependencyBytes : nullptr;
+    }
+
+    uint32_t const *Indices() const
+    {
+        if (_header == nullptr)
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<uint32_t const *>(static_cast<unsigned char const *>(Vertices()) + size_t(_header->_vertexCount) * _header->_vertexSize);
+    }
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,183 @@
+#ifndef OBJMODEL_H
+#define OBJMODEL_H
+
+// tiny_obj_loader.h has no guard around its implementation part
+#ifndef TINY_OBJ_LOADER_H_
+#include <tiny_obj_loader.h>
+#endif
+
+#include "objparallel.h"
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ObjParseMode
+{
+    Stream,   // tinyobj::LoadObj() on one thread
+    Parallel, // ObjParallel::LoadObj() on all cores
+};
+
+// All shapes and materials of one OBJ file. The file is parsed at most once,
+// the first time something asks for its contents, so any number of buffers
+// can be built from it with BufferType::loadObj(model, shapeName). Parse()
+// is safe to call from more threads at once, the contents are only read
+// after it returned.
+class ObjModel
+{
+    // Reads the .mtl files like tinyobj does and remembers which ones it
+    // looked for, found or not
+    class MaterialFileRecorder : public tinyobj::MaterialReader
+    {
+        tinyobj::MaterialFileReader _reader;
+        std::string _materialPath;
+        std::vector<std::string> &_files;
+
+    public:
+        MaterialFileRecorder(std::string const &materialPath, std::vector<std::string> &files)
+            : _reader(materialPath), _materialPath(materialPath), _files(files)
+        {}
+
+        virtual bool operator()(const std::string &matId, std::vector<tinyobj::material_t> *materials,
+                                std::map<std::string, int> *matMap, std::string *err)
+        {
+            _files.push_back(_materialPath + matId);
+
+            return _reader(matId, materials, matMap, err);
+        }
+    };
+
+    std::string _filename;
+    std::string _materialPath;
+    ObjParseMode _mode;
+    int _threadCount;
+
+    tinyobj::attrib_t _attrib;
+    std::vector<tinyobj::shape_t> _shapes;
+    std::vector<tinyobj::material_t> _materials;
+    std::vector<std::string> _materialFiles;
+
+    bool _parsed;
+    bool _valid;
+    mutable std::mutex _mutex;
+
+public:
+    // A threadCount of 0 uses one thread per core for the Parallel mode
+    ObjModel(std::string const &filename, std::string const &materialPath, ObjParseMode mode = ObjParseMode::Parallel, int threadCount = 0)
+        : _filename(filename), _materialPath(materialPath), _mode(mode), _threadCount(threadCount), _parsed(false), _valid(false)
+    {}
+
+    virtual ~ObjModel() {}
+
+    // Parses the file on the first call, later calls return the same result
+    bool Parse()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_parsed)
+        {
+            return _valid;
+        }
+
+        _parsed = true;
+
+        std::string err;
+        MaterialFileRecorder materialReader(_materialPath, _materialFiles);
+        if (_mode == ObjParseMode::Parallel)
+        {
+            _valid = ObjParallel::LoadObj(&_attrib, &_shapes, &_materials, &err, _filename.c_str(), _materialPath.c_str(), true, _threadCount, &materialReader);
+        }
+        else
+        {
+            std::ifstream file(_filename);
+            _valid = file.is_open() && tinyobj::LoadObj(&_attrib, &_shapes, &_materials, &err, &file, &materialReader);
+            if (!file.is_open())
+            {
+                err = "Cannot open file [" + _filename + "]";
+            }
+        }
+
+        if (!_valid)
+        {
+            std::cerr << "LoadObj failed for \"" << _filename << "\": " << err << std::endl;
+        }
+
+        return _valid;
+    }
+
+    // Only has an effect before the model is parsed
+    void SetThreadCount(int threadCount)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _threadCount = threadCount;
+    }
+
+    bool IsParsed() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        return _parsed;
+    }
+
+    std::string const &Filename() const
+    {
+        return _filename;
+    }
+
+    std::string const &MaterialPath() const
+    {
+        return _materialPath;
+    }
+
+    tinyobj::attrib_t const &Attrib() const
+    {
+        return _attrib;
+    }
+
+    std::vector<tinyobj::shape_t> const &Shapes() const
+    {
+        return _shapes;
+    }
+
+    std::vector<tinyobj::material_t> const &Materials() const
+    {
+        return _materials;
+    }
+
+    // Every .mtl file the parse tried to read, also the ones that were missing
+    std::vector<std::string> const &MaterialFiles() const
+    {
+        return _materialFiles;
+    }
+
+    // Returns nullptr when there is no such shape or the file is not parsed yet
+    tinyobj::shape_t const *FindShape(std::string const &name) const
+    {
+        for (auto const &shape : _shapes)
+        {
+            if (shape.name == name)
+            {
+                return &shape;
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::vector<std::string> ShapeNames() const
+    {
+        std::vector<std::string> names;
+        names.reserve(_shapes.size());
+        for (auto const &shape : _shapes)
+        {
+            names.push_back(shape.name);
+        }
+
+        return names;
+    }
+};
+
+#endif // OBJMODEL_H
@@ -0,0 +1,643 @@
+#ifndef OBJPARALLEL_H
+#define OBJPARALLEL_H
+
+// tiny_obj_loader.h has no guard around its implementation part
+#ifndef TINY_OBJ_LOADER_H_
+#include <tiny_obj_loader.h>
+#endif
+
+#include <string>
+#include <vector>
+
+// Multithreaded drop-in for tinyobj::LoadObj(). The file is memory mapped and
+// split into line aligned chunks, each chunk is parsed on its own thread and
+// the results are merged in file order, so the output is the same as what
+// tinyobj::LoadObj() returns for the file.
+//
+// The parsing and triangulation are tinyobj's own, so the implementation has
+// to live in the same translation unit as the tinyobj one:
+//
+//   #define TINYOBJLOADER_IMPLEMENTATION
+//   #include <tiny_obj_loader.h>
+//   #define OBJPARALLEL_IMPLEMENTATION
+//   #include <objparallel.h>
+namespace ObjParallel {
+
+// A threadCount of 0 uses one thread per core. When readMatFn is set it reads
+// the materials instead of mtl_basedir.
+bool LoadObj(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes,
+             std::vector<tinyobj::material_t> *materials, std::string *err,
+             const char *filename, const char *mtl_basedir = NULL,
+             bool triangulate = true, int threadCount = 0,
+             tinyobj::MaterialReader *readMatFn = NULL);
+
+} // namespace ObjParallel
+
+#endif // OBJPARALLEL_H
+
+#if defined(OBJPARALLEL_IMPLEMENTATION) && !defined(OBJPARALLEL_IMPLEMENTED)
+#define OBJPARALLEL_IMPLEMENTED
+
+#ifndef TINYOBJLOADER_IMPLEMENTATION
+#error "objparallel.h needs the tinyobj implementation in the same translation unit"
+#endif
+
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <thread>
+
+namespace ObjParallel {
+
+namespace detail {
+
+// Chunks smaller than this are not worth a thread of their own
+static const size_t MinChunkSize = 1 << 20;
+
+// Negative (relative) indices in a face can only be resolved once the vertex
+// counts of all earlier chunks are known. Until then they are stored relative
+// to the start of the chunk and biased far below the -1 tinyobj uses for a
+// missing index.
+static const int RelativeBias = 1 << 30;
+
+enum StatementType
+{
+    StatementNone,
+    StatementUseMtl,
+    StatementMtlLib,
+    StatementGroup,
+    StatementObject,
+    StatementTag,
+};
+
+// A statement that changes the loader state and the faces that follow it, up
+// to the next statement
+struct Segment
+{
+    StatementType _type;
+    std::string _line;
+    std::vector<std::vector<tinyobj::vertex_index> > _faces;
+    size_t _faceCount;
+    tinyobj::shape_t _shape;
+};
+
+struct Chunk
+{
+    char const *_begin;
+    char const *_end;
+
+    std::vector<tinyobj::real_t> _v;
+    std::vector<tinyobj::real_t> _vn;
+    std::vector<tinyobj::real_t> _vt;
+    std::vector<tinyobj::real_t> _vc;
+    std::vector<Segment> _segments;
+
+    // Offsets of this chunk's attributes in the merged arrays, in elements
+    size_t _vBase;
+    size_t _vnBase;
+    size_t _vtBase;
+
+    bool _failed;
+};
+
+template <class Function>
+static void parallelFor(size_t count, int threadCount, Function function)
+{
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            function(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount && size_t(t) < count; t++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+
+    worker();
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+static void addSegment(Chunk &chunk, StatementType type, char const *line)
+{
+    Segment segment;
+    segment._type = type;
+    segment._line = line;
+    segment._faceCount = 0;
+
+    chunk._segments.push_back(segment);
+}
+
+// Same line handling as tinyobj::LoadObj(), except that state changing
+// statements are only recorded to be replayed in order by mergeChunks()
+static void parseChunk(Chunk &chunk)
+{
+    using namespace tinyobj;
+
+    addSegment(chunk, StatementNone, "");
+
+    std::string linebuf;
+    char const *p = chunk._begin;
+
+    while (p < chunk._end)
+    {
+        char const *lineEnd = p;
+        while (lineEnd < chunk._end && *lineEnd != '\n' && *lineEnd != '\r')
+        {
+            lineEnd++;
+        }
+
+        linebuf.assign(p, lineEnd);
+
+        p = lineEnd;
+        if (p < chunk._end && *p == '\r')
+        {
+            p++;
+        }
+        if (p < chunk._end && *p == '\n')
+        {
+            p++;
+        }
+
+        const char *token = linebuf.c_str();
+        token += strspn(token, " \t");
+
+        if (token[0] == '\0' || token[0] == '#')
+        {
+            continue;
+        }
+
+        if (token[0] == 'v' && IS_SPACE((token[1])))
+        {
+            token += 2;
+            real_t x, y, z;
+            real_t r, g, b;
+            parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+            chunk._v.push_back(x);
+            chunk._v.push_back(y);
+            chunk._v.push_back(z);
+
+            chunk._vc.push_back(r);
+            chunk._vc.push_back(g);
+            chunk._vc.push_back(b);
+            continue;
+        }
+
+        if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2])))
+        {
+            token += 3;
+            real_t x, y, z;
+            parseReal3(&x, &y, &z, &token);
+            chunk._vn.push_back(x);
+            chunk._vn.push_back(y);
+            chunk._vn.push_back(z);
+            continue;
+        }
+
+        if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2])))
+        {
+            token += 3;
+            real_t x, y;
+            parseReal2(&x, &y, &token);
+            chunk._vt.push_back(x);
+            chunk._vt.push_back(y);
+            continue;
+        }
+
+        if (token[0] == 'f' && IS_SPACE((token[1])))
+        {
+            token += 2;
+            token += strspn(token, " \t");
+
+            std::vector<vertex_index> face;
+            face.reserve(3);
+
+            while (!IS_NEW_LINE(token[0]))
+            {
+                vertex_index vi;
+                if (!parseTriple(&token,
+                                 static_cast<int>(chunk._v.size() / 3) - RelativeBias,
+                                 static_cast<int>(chunk._vn.size() / 3) - RelativeBias,
+                                 static_cast<int>(chunk._vt.size() / 2) - RelativeBias, &vi))
+                {
+                    chunk._failed = true;
+                    return;
+                }
+
+                face.push_back(vi);
+                token += strspn(token, " \t\r");
+            }
+
+            auto &segment = chunk._segments.back();
+            segment._faces.push_back(std::vector<vertex_index>());
+            segment._faces.back().swap(face);
+            segment._faceCount++;
+            continue;
+        }
+
+        if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6])))
+        {
+            addSegment(chunk, StatementUseMtl, token);
+            continue;
+        }
+
+        if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6])))
+        {
+            addSegment(chunk, StatementMtlLib, token);
+            continue;
+        }
+
+        if (token[0] == 'g' && IS_SPACE((token[1])))
+        {
+            addSegment(chunk, StatementGroup, token);
+            continue;
+        }
+
+        if (token[0] == 'o' && IS_SPACE((token[1])))
+        {
+            addSegment(chunk, StatementObject, token);
+            continue;
+        }
+
+        if (token[0] == 't' && IS_SPACE(token[1]))
+        {
+            addSegment(chunk, StatementTag, token);
+            continue;
+        }
+
+        // Ignore unknown command.
+    }
+}
+
+static void resolveIndex(int &index, size_t base)
+{
+    if (index < -(RelativeBias / 2))
+    {
+        index += RelativeBias + static_cast<int>(base);
+    }
+}
+
+// Fixes up the relative indices and triangulates the faces of every segment,
+// needs the merged vertex positions
+static void triangulateChunk(Chunk &chunk, bool triangulate, std::vector<tinyobj::real_t> const &v)
+{
+    static const std::vector<tinyobj::tag_t> noTags;
+
+    for (auto &segment : chunk._segments)
+    {
+        for (auto &face : segment._faces)
+        {
+            for (auto &vi : face)
+            {
+                resolveIndex(vi.v_idx, chunk._vBase);
+                resolveIndex(vi.vn_idx, chunk._vnBase);
+                resolveIndex(vi.vt_idx, chunk._vtBase);
+            }
+        }
+
+        tinyobj::exportFaceGroupToShape(&segment._shape, segment._faces, noTags, -1, "", triangulate, v);
+
+        std::vector<std::vector<tinyobj::vertex_index> >().swap(segment._faces);
+    }
+}
+
+template <class T>
+static void append(std::vector<T> &to, std::vector<T> const &from)
+{
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+// Replays the statements of all chunks in file order with the same state
+// machine as tinyobj::LoadObj()
+static void mergeChunks(std::vector<Chunk> &chunks, std::vector<tinyobj::shape_t> *shapes,
+                        std::vector<tinyobj::material_t> *materials, std::string *err,
+                        tinyobj::MaterialReader *readMatFn)
+{
+    using namespace tinyobj;
+
+    std::vector<tag_t> tags;
+    std::string name;
+    std::map<std::string, int> material_map;
+    int material = -1;
+
+    shape_t shape;
+    size_t pendingFaces = 0;
+
+    // Same result as exportFaceGroupToShape() on the faces since the last flush,
+    // they are already in shape and only need their name, tags and material
+    size_t pendingStart = 0;
+    auto flush = [&]() -> bool {
+        if (pendingFaces == 0)
+        {
+            return false;
+        }
+
+        std::fill(shape.mesh.material_ids.begin() + std::ptrdiff_t(pendingStart), shape.mesh.material_ids.end(), material);
+        shape.name = name;
+        shape.mesh.tags = tags;
+
+        pendingFaces = 0;
+        pendingStart = shape.mesh.material_ids.size();
+
+        return true;
+    };
+    auto newShape = [&]() {
+        shape = shape_t();
+        pendingStart = 0;
+    };
+
+    for (auto &chunk : chunks)
+    {
+        for (auto &segment : chunk._segments)
+        {
+            const char *token = segment._line.c_str();
+
+            switch (segment._type)
+            {
+                case StatementUseMtl:
+                {
+                    std::string namebuf(token + 7);
+
+                    int newMaterialId = -1;
+                    if (material_map.find(namebuf) != material_map.end())
+                    {
+                        newMaterialId = material_map[namebuf];
+                    }
+
+                    if (newMaterialId != material)
+                    {
+                        flush();
+                        material = newMaterialId;
+                    }
+                    break;
+                }
+                case StatementMtlLib:
+                {
+                    if (readMatFn == NULL)
+                    {
+                        break;
+                    }
+
+                    std::vector<std::string> filenames;
+                    SplitString(std::string(token + 7), ' ', filenames);
+
+                    if (filenames.empty())
+                    {
+                        if (err)
+                        {
+                            (*err) += "WARN: Looks like empty filename for mtllib. Use default material. \n";
+                        }
+                        break;
+                    }
+
+                    bool found = false;
+                    for (size_t s = 0; s < filenames.size(); s++)
+                    {
+                        std::string err_mtl;
+                        bool ok = (*readMatFn)(filenames[s].c_str(), materials, &material_map, &err_mtl);
+                        if (err && (!err_mtl.empty()))
+                        {
+                            (*err) += err_mtl;
+                        }
+
+                        if (ok)
+                        {
+                            found = true;
+                            break;
+                        }
+                    }
+
+                    if (!found && err)
+                    {
+                        (*err) += "WARN: Failed to load material file(s). Use default material.\n";
+                    }
+                    break;
+                }
+                case StatementGroup:
+                {
+                    flush();
+
+                    if (shape.mesh.indices.size() > 0)
+                    {
+                        shapes->push_back(shape);
+                    }
+
+                    newShape();
+
+                    std::vector<std::string> names;
+                    while (!IS_NEW_LINE(token[0]))
+                    {
+                        names.push_back(parseString(&token));
+                        token += strspn(token, " \t\r");
+                    }
+
+                    // names[0] is the 'g' itself
+                    name = names.size() > 1 ? names[1] : "";
+                    break;
+                }
+                case StatementObject:
+                {
+                    if (flush())
+                    {
+                        shapes->push_back(shape);
+                    }
+
+                    newShape();
+                    name = token + 2;
+                    break;
+                }
+                case StatementTag:
+                {
+                    tag_t tag;
+
+                    token += 2;
+                    tag.name = parseString(&token);
+
+                    tag_sizes ts = parseTagTriple(&token);
+
+                    tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+                    for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i)
+                    {
+                        tag.intValues[i] = parseInt(&token);
+                    }
+
+                    tag.floatValues.resize(static_cast<size_t>(ts.num_reals));
+                    for (size_t i = 0; i < static_cast<size_t>(ts.num_reals); ++i)
+                    {
+                        tag.floatValues[i] = parseReal(&token);
+                    }
+
+                    tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+                    for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i)
+                    {
+                        tag.stringValues[i] = parseString(&token);
+                    }
+
+                    tags.push_back(tag);
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            if (segment._faceCount > 0)
+            {
+                append(shape.mesh.indices, segment._shape.mesh.indices);
+                append(shape.mesh.num_face_vertices, segment._shape.mesh.num_face_vertices);
+                append(shape.mesh.material_ids, segment._shape.mesh.material_ids);
+                pendingFaces += segment._faceCount;
+            }
+            segment._shape = shape_t();
+        }
+    }
+
+    if (flush() || shape.mesh.indices.size())
+    {
+        shapes->push_back(shape);
+    }
+}
+
+} // namespace detail
+
+bool LoadObj(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes,
+             std::vector<tinyobj::material_t> *materials, std::string *err,
+             const char *filename, const char *mtl_basedir, bool triangulate, int threadCount,
+             tinyobj::MaterialReader *readMatFn)
+{
+    using namespace detail;
+
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    attrib->colors.clear();
+    shapes->clear();
+
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        // An empty file can not be mapped but is still a valid OBJ
+        std::ifstream ifs(filename);
+        if (!ifs)
+        {
+            if (err)
+            {
+                (*err) = std::string("Cannot open file [") + filename + "]\n";
+            }
+            return false;
+        }
+
+        return true;
+    }
+
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    }
+
+    // A few chunks per thread so one slow chunk does not hold up the rest
+    auto data = static_cast<char const *>(file.Data());
+    auto size = file.Size();
+    auto chunkCount = std::max(size_t(1), std::min(size / MinChunkSize, size_t(threadCount) * 4));
+
+    std::vector<Chunk> chunks;
+    chunks.reserve(chunkCount);
+
+    char const *begin = data;
+    for (size_t i = 0; i < chunkCount && begin < data + size; i++)
+    {
+        auto end = (i + 1 == chunkCount) ? data + size : data + size * (i + 1) / chunkCount;
+        if (end < begin)
+        {
+            end = begin;
+        }
+
+        // Chunks end after a line break, so "\r\n" is never split
+        while (end > data && end < data + size && end[-1] != '\n')
+        {
+            end++;
+        }
+
+        Chunk chunk;
+        chunk._begin = begin;
+        chunk._end = end;
+        chunk._vBase = chunk._vnBase = chunk._vtBase = 0;
+        chunk._failed = false;
+        chunks.push_back(chunk);
+
+        begin = end;
+    }
+
+    parallelFor(chunks.size(), threadCount, [&](size_t i) {
+        parseChunk(chunks[i]);
+    });
+
+    size_t vCount = 0, vnCount = 0, vtCount = 0;
+    for (auto &chunk : chunks)
+    {
+        if (chunk._failed)
+        {
+            if (err)
+            {
+                (*err) = "Failed parse `f' line(e.g. zero value for face index).\n";
+            }
+            return false;
+        }
+
+        chunk._vBase = vCount;
+        chunk._vnBase = vnCount;
+        chunk._vtBase = vtCount;
+
+        vCount += chunk._v.size() / 3;
+        vnCount += chunk._vn.size() / 3;
+        vtCount += chunk._vt.size() / 2;
+    }
+
+    attrib->vertices.resize(vCount * 3);
+    attrib->colors.resize(vCount * 3);
+    attrib->normals.resize(vnCount * 3);
+    attrib->texcoords.resize(vtCount * 2);
+
+    parallelFor(chunks.size(), threadCount, [&](size_t i) {
+        auto &chunk = chunks[i];
+
+        std::copy(chunk._v.begin(), chunk._v.end(), attrib->vertices.begin() + std::ptrdiff_t(chunk._vBase * 3));
+        std::copy(chunk._vc.begin(), chunk._vc.end(), attrib->colors.begin() + std::ptrdiff_t(chunk._vBase * 3));
+        std::copy(chunk._vn.begin(), chunk._vn.end(), attrib->normals.begin() + std::ptrdiff_t(chunk._vnBase * 3));
+        std::copy(chunk._vt.begin(), chunk._vt.end(), attrib->texcoords.begin() + std::ptrdiff_t(chunk._vtBase * 2));
+
+        std::vector<tinyobj::real_t>().swap(chunk._v);
+        std::vector<tinyobj::real_t>().swap(chunk._vc);
+        std::vector<tinyobj::real_t>().swap(chunk._vn);
+        std::vector<tinyobj::real_t>().swap(chunk._vt);
+    });
+
+    parallelFor(chunks.size(), threadCount, [&](size_t i) {
+        triangulateChunk(chunks[i], triangulate, attrib->vertices);
+    });
+
+    std::string baseDir;
+    if (mtl_basedir)
+    {
+        baseDir = mtl_basedir;
+    }
+    tinyobj::MaterialFileReader matFileReader(baseDir);
+
+    mergeChunks(chunks, shapes, materials, err, readMatFn != NULL ? readMatFn : &matFileReader);
+
+    return true;
+}
+
+} // namespace ObjParallel
+
+#endif // OBJPARALLEL_IMPLEMENTATION
@@ -0,0 +1,157 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "gl-color-normal-position-vertex.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Render state that is part of the sort key, so draws sharing it end up next
+// to each other
+enum RenderFlags
+{
+    RenderFlagsNone = 0,
+    RenderFlagsClockwise = 1 << 0,   // glFrontFace(GL_CW) instead of GL_CCW
+    RenderFlagsNoDepthTest = 1 << 1, // draws on top of everything
+};
+
+// Collects the draws of a frame and submits them sorted by shader, render
+// state, vertex array and depth, only switching GL state when it changes.
+//
+// Key layout from the high to the low bits:
+//   16 bits shader program, 8 bits flags, 16 bits vertex array, 24 bits depth
+class RenderQueue
+{
+    struct Item
+    {
+        uint64_t _key;
+        ShaderType const *_shader;
+        BufferType *_buffer;
+        glm::mat4 _model;
+        unsigned char _flags;
+        bool _instanced;
+    };
+
+    std::vector<Item> _items;
+    glm::mat4 _view;
+
+    static uint64_t makeKey(ShaderType const *shader, BufferType const *buffer, unsigned char flags, float depth)
+    {
+        // For positive floats the bit pattern sorts like the value, so the
+        // top 24 bits are a coarse but ordered depth
+        depth = std::max(depth, 0.0f);
+        uint32_t depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+
+        return (uint64_t(shader->id() & 0xffff) << 48) |
+               (uint64_t(flags) << 40) |
+               (uint64_t(buffer->vertexArrayId() & 0xffff) << 24) |
+               uint64_t(depthBits >> 8);
+    }
+
+    static void applyFlags(unsigned char flags)
+    {
+        glFrontFace((flags & RenderFlagsClockwise) ? GL_CW : GL_CCW);
+
+        if (flags & RenderFlagsNoDepthTest)
+        {
+            glDisable(GL_DEPTH_TEST);
+        }
+        else
+        {
+            glEnable(GL_DEPTH_TEST);
+        }
+    }
+
+public:
+    RenderQueue()
+        : _view(1.0f)
+    {
+        _items.reserve(256);
+    }
+
+    // The view matrix is only used for the depth part of the key
+    void Begin(glm::mat4 const &view)
+    {
+        _items.clear();
+        _view = view;
+    }
+
+    void Add(ShaderType const *shader, BufferType *buffer, glm::mat4 const &model, unsigned char flags = RenderFlagsNone)
+    {
+        auto depth = -(_view * model[3]).z;
+
+        _items.push_back({makeKey(shader, buffer, flags, depth), shader, buffer, model, flags, false});
+    }
+
+    // The buffer draws its own instance matrices, see BufferType::setupInstances()
+    void AddInstanced(ShaderType const *shader, BufferType *buffer, unsigned char flags = RenderFlagsNone)
+    {
+        if (buffer->instanceCount() <= 0)
+        {
+            return;
+        }
+
+        _items.push_back({makeKey(shader, buffer, flags, 0.0f), shader, buffer, glm::mat4(1.0f), flags, true});
+    }
+
+    size_t ItemCount() const
+    {
+        return _items.size();
+    }
+
+    // Leaves the front face at GL_CCW and depth testing on
+    void Submit(glm::mat4 const &projection)
+    {
+        std::sort(_items.begin(), _items.end(), [](Item const &a, Item const &b) {
+            return a._key < b._key;
+        });
+
+        ShaderType const *currentShader = nullptr;
+        unsigned int currentVertexArray = 0;
+        int currentFlags = -1;
+
+        for (auto const &item : _items)
+        {
+            if (item._shader != currentShader)
+            {
+                currentShader = item._shader;
+                currentShader->use();
+                currentShader->setupCamera(projection, _view);
+            }
+
+            if (int(item._flags) != currentFlags)
+            {
+                currentFlags = item._flags;
+                applyFlags(item._flags);
+            }
+
+            if (item._buffer->vertexArrayId() != currentVertexArray)
+            {
+                currentVertexArray = item._buffer->vertexArrayId();
+                glBindVertexArray(currentVertexArray);
+            }
+
+            currentShader->setupModel(item._model);
+
+            if (item._instanced)
+            {
+                item._buffer->drawInstanced();
+            }
+            else
+            {
+                item._buffer->draw();
+            }
+        }
+
+        if (currentFlags != RenderFlagsNone && currentFlags != -1)
+        {
+            applyFlags(RenderFlagsNone);
+        }
+        glBindVertexArray(0);
+    }
+};
+
+#endif // RENDERQUEUE_H
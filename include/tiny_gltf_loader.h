@@ -395,14 +395,14 @@ struct BufferView{
   int buffer;  // Required
   size_t byteOffset;   // minimum 0, default 0
   size_t byteLength;   // required, minimum 1
-  size_t byteStride;  // minimum 4, maximum 252 (multiple of 4)
+  size_t byteStride;  // 0 when tightly packed, else 4 to 252 (multiple of 4)
   int target; // ["ARRAY_BUFFER", "ELEMENT_ARRAY_BUFFER"]
   int pad0;
   Value extras;
 
   BufferView()
     : byteOffset(0)
-    , byteStride(4)
+    , byteStride(0)
   {}  
 
 };
@@ -417,8 +417,8 @@ struct Accessor {
   int type;  // (required) One of TINYGLTF_TYPE_***   ..
   Value extras;
 
-  std::vector<double> minValues;  // required
-  std::vector<double> maxValues;  // required
+  std::vector<double> minValues;  // required for POSITION only
+  std::vector<double> maxValues;  // required for POSITION only
 
   Accessor()
   {
@@ -1581,8 +1581,8 @@ static bool ParseBufferView(BufferView *bufferView, std::string *err,
     return false;
   }
 
-  double byteStride = 4.0;
-  ParseNumberProperty(&byteLength, err, o, "byteStride", false);
+  double byteStride = 0.0;
+  ParseNumberProperty(&byteStride, err, o, "byteStride", false);
 
   double target = 0.0;
   ParseNumberProperty(&target, err, o, "target", false);
@@ -1660,13 +1660,8 @@ static bool ParseAccessor(Accessor *accessor, std::string *err,
 
   accessor->minValues.clear();
   accessor->maxValues.clear();
-  if(!ParseNumberArrayProperty(&accessor->minValues, err, o, "min", true, "Accessor")) {
-    return false;
-  }
-
-  if(!ParseNumberArrayProperty(&accessor->maxValues, err, o, "max", true, "Accessor")) {
-    return false;
-  }
+  ParseNumberArrayProperty(&accessor->minValues, err, o, "min", false);
+  ParseNumberArrayProperty(&accessor->maxValues, err, o, "max", false);
 
   accessor->count = static_cast<size_t>(count);
   accessor->bufferView = static_cast<int>(bufferView);
@@ -0,0 +1,61 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Single producer, single consumer triple buffer. The producer fills
+// WriteBuffer() and calls Publish(), the consumer calls Consume() and reads
+// ReadBuffer(). Neither side ever waits for the other, the consumer simply
+// gets the newest published buffer.
+template <class T>
+class TripleBuffer
+{
+    static const unsigned char DirtyBit = 0x4;
+    static const unsigned char IndexMask = 0x3;
+
+    T _buffers[3];
+    std::atomic<unsigned char> _middle;
+    unsigned char _write;
+    unsigned char _read;
+
+public:
+    TripleBuffer()
+        : _middle(1), _write(0), _read(2)
+    {}
+
+    // Only touch from the producer thread
+    T &WriteBuffer()
+    {
+        return _buffers[_write];
+    }
+
+    // Hands the write buffer to the consumer and takes the spare one back
+    void Publish()
+    {
+        auto previous = _middle.exchange(_write | DirtyBit, std::memory_order_acq_rel);
+        _write = previous & IndexMask;
+    }
+
+    // Returns false when nothing new was published since the last call, the
+    // read buffer then still holds the previous frame
+    bool Consume()
+    {
+        if ((_middle.load(std::memory_order_acquire) & DirtyBit) == 0)
+        {
+            return false;
+        }
+
+        auto previous = _middle.exchange(_read, std::memory_order_acq_rel);
+        _read = previous & IndexMask;
+
+        return true;
+    }
+
+    // Only touch from the consumer thread
+    T const &ReadBuffer() const
+    {
+        return _buffers[_read];
+    }
+};
+
+#endif // TRIPLEBUFFER_H
@@ -17,14 +17,29 @@ bool operator < (UserInputEvent const &a, UserInputEvent const &b)
     return a.source < b.source;
 }
 
+UserInput::UserInput()
+    : _mappingMode(false), _actionToMap(UserInputActions::Count)
+{}
+
 void UserInput::StartMappingAction(UserInputActions action)
 {
-    _mappingMode = true;
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+
     _actionToMap = action;
+    _mappingMode = true;
+}
+
+void UserInput::MapAction(UserInputEvent const &event, UserInputActions action)
+{
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+
+    _stateMapping[event] = action;
 }
 
 std::vector<UserInputEvent> UserInput::GetMappedActionEvents(UserInputActions action)
 {
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+
     std::vector<UserInputEvent> result;
 
     for (auto pair : _stateMapping)
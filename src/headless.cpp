@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include "game.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+#define OBJPARALLEL_IMPLEMENTATION
+#include <objparallel.h>
+#define TINYGLTF_LOADER_IMPLEMENTATION
+#include <tiny_gltf_loader.h>
+
+// Runs the game logic without a window or GL context. Only SetupSimulation()
+// and Update() are called, input comes from a script instead of SDL.
+//
+// usage: icy-february-headless [--steps N] [--dt MS] [--script FILE]
+//
+// A script has one "<step> <key> <down>" entry per line, where key is an SDL
+// keycode like in the keymap file and down is 1 for press and 0 for release.
+
+struct ScriptedInput
+{
+    int step;
+    UserInputEvent event;
+    bool state;
+};
+
+static std::vector<ScriptedInput> readScript(std::string const &filename)
+{
+    std::vector<ScriptedInput> result;
+
+    std::ifstream infile(filename);
+
+    if (!infile.is_open())
+    {
+        std::cerr << "could not open \"" << filename << "\" for reading" << std::endl;
+        return result;
+    }
+
+    std::string line;
+    while (std::getline(infile, line))
+    {
+        std::istringstream iss(line);
+        ScriptedInput input = {0, {SDL_KEYDOWN, 0}, false};
+        int state = 0;
+
+        if (iss >> input.step >> input.event.key >> state)
+        {
+            input.state = (state != 0);
+            result.push_back(input);
+        }
+    }
+
+    std::stable_sort(result.begin(), result.end(), [](ScriptedInput const &a, ScriptedInput const &b) {
+        return a.step < b.step;
+    });
+
+    return result;
+}
+
+// Walks forward, strafes left and right and jumps now and then
+static std::vector<ScriptedInput> defaultScript(int steps)
+{
+    std::vector<ScriptedInput> result;
+
+    for (int step = 0; step < steps; step += 240)
+    {
+        result.push_back({step, {SDL_KEYDOWN, SDLK_w}, true});
+        result.push_back({step + 60, {SDL_KEYDOWN, SDLK_a}, true});
+        result.push_back({step + 90, {SDL_KEYDOWN, SDLK_a}, false});
+        result.push_back({step + 100, {SDL_KEYDOWN, SDLK_SPACE}, true});
+        result.push_back({step + 101, {SDL_KEYDOWN, SDLK_SPACE}, false});
+        result.push_back({step + 120, {SDL_KEYDOWN, SDLK_w}, false});
+        result.push_back({step + 120, {SDL_KEYDOWN, SDLK_s}, true});
+        result.push_back({step + 180, {SDL_KEYDOWN, SDLK_d}, true});
+        result.push_back({step + 210, {SDL_KEYDOWN, SDLK_d}, false});
+        result.push_back({step + 239, {SDL_KEYDOWN, SDLK_s}, false});
+    }
+
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int steps = 10000;
+    int dt = 1000 / 60;
+    std::string scriptFile;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+        {
+            steps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc)
+        {
+            dt = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+        {
+            scriptFile = argv[++i];
+        }
+    }
+
+    Game &game = Game::Instantiate(argc, argv);
+
+    // The keymap file is not read here, so runs do not depend on local settings
+    game._userInput.MapAction({SDL_KEYDOWN, SDLK_w}, UserInputActions::SpeedUp);
+    game._userInput.MapAction({SDL_KEYDOWN, SDLK_s}, UserInputActions::SpeedDown);
+    game._userInput.MapAction({SDL_KEYDOWN, SDLK_a}, UserInputActions::SteerLeft);
+    game._userInput.MapAction({SDL_KEYDOWN, SDLK_d}, UserInputActions::SteerRight);
+    game._userInput.MapAction({SDL_KEYDOWN, SDLK_SPACE}, UserInputActions::Jump);
+
+    if (!game.SetupSimulation())
+    {
+        std::cerr << "Game.SetupSimulation() failed!" << std::endl;
+        return 1;
+    }
+
+    auto script = scriptFile.empty() ? defaultScript(steps) : readScript(scriptFile);
+    size_t nextInput = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int step = 0; step < steps; step++)
+    {
+        while (nextInput < script.size() && script[nextInput].step <= step)
+        {
+            game._userInput.ProcessEvent(script[nextInput].event, script[nextInput].state);
+            nextInput++;
+        }
+
+        game.Update(dt);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << steps << " updates of " << dt << " ms (" << (steps * dt) / 1000.0 << " s simulated)"
+              << " in " << seconds << " s, "
+              << (seconds > 0.0 ? steps / seconds : 0.0) << " updates/second" << std::endl;
+
+    game.Destroy();
+
+    return 0;
+}
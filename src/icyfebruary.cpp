@@ -1,7 +1,9 @@
 #include "icyfebruary.h"
+#include <algorithm>
 #include <capabilityguard.h>
 #include <glad/glad.h>
 #include <imgui.h>
+#include <memory>
 
 #define SYSTEM_IO_FILEINFO_IMPLEMENTATION
 #include <system.io.fileinfo.h>
@@ -12,6 +14,9 @@
 
 #define KEYMAP_FILE "icyfebruary.keymap"
 
+// Time per frame Render() spends on uploading loaded assets
+#define ASSET_UPLOAD_BUDGET_MS 2.0
+
 ColorPosition::ShaderType CreationObject::_shader;
 GLuint ColorPosition::ShaderType::defaultShader = 0;
 
@@ -62,6 +67,17 @@ void CreationObject::rebuildBuffer()
     _buffer.setup(&_shader);
 }
 
+CreationObject::CreationObject()
+    : _object(nullptr)
+{}
+
+FrameSnapshot::FrameSnapshot()
+    : _characterMatrix(1.0f), _propCount(0)
+{
+    _lastStep._subSteps = 0;
+    _lastStep._droppedTime = 0.0f;
+}
+
 Game &Game::Instantiate(int argc, char *argv[])
 {
     static IcyFebruary game(argc, argv);
@@ -70,21 +86,17 @@ Game &Game::Instantiate(int argc, char *argv[])
 }
 
 IcyFebruary::IcyFebruary(int argc, char *argv[])
-    : _showPhysicsDebug(true), _create(nullptr)
+    : _showPhysicsDebug(true), _collectPhysicsDebug(true), _menuMode(MenuModes::NoMenu), _hasCullMatrix(false),
+      _visibleCount(0), _renderableCount(0), _create(nullptr)
 {
     System::IO::FileInfo exe(argv[0]);
     _settingsDir = exe.Directory().FullName();
+
+    _debugOptions = _cullDebugOptions = _physics.DebugOptions();
 }
 
-unsigned int IcyFebruary::uploadTexture(std::string const &filename)
+static unsigned int createTexture(unsigned char const *pixels, int width, int height)
 {
-    int x, y, comp;
-    auto pixels = stbi_load(filename.c_str(), &x, &y, &comp, 3);
-    if (pixels == nullptr)
-    {
-        return 0;
-    }
-
     unsigned int texture = 0;
 
     glGenTextures(1, &texture);
@@ -92,18 +104,35 @@ unsigned int IcyFebruary::uploadTexture(std::string const &filename)
     glBindTexture(GL_TEXTURE_2D, texture);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, comp == 4 ? GL_RGBA : GL_RGB, x, y, 0, comp == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    // Rows of RGB pixels are not always four byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glGenerateMipmap(GL_TEXTURE_2D);
 
-    free(pixels);
-
     glBindTexture(GL_TEXTURE_2D, 0);
 
     return texture;
 }
 
+unsigned int IcyFebruary::uploadTexture(std::string const &filename)
+{
+    int x, y, comp;
+    auto pixels = stbi_load(filename.c_str(), &x, &y, &comp, 3);
+    if (pixels == nullptr)
+    {
+        return 0;
+    }
+
+    auto texture = createTexture(pixels, x, y);
+
+    stbi_image_free(pixels);
+
+    return texture;
+}
+
 bool IcyFebruary::Setup()
 {
     _camOffset[0] = 0.0f;
@@ -126,10 +155,39 @@ bool IcyFebruary::Setup()
     glClearColor(0.56f, 0.7f, 0.67f, 1.0f);
 
     // Setting up the shaders
+    _frameUniforms.setup();
     _boxShader.compileDefaultShader();
 
     //    CreationObject::_shader.compileDefaultShader();
 
+    if (!SetupSimulation())
+    {
+        return false;
+    }
+
+    // The meshes stream in while the first frames are already drawn, Render()
+    // skips them until they are uploaded
+    _assets.Start();
+    _assets.LoadMesh(_character, "../02-icy-february/assets/hjmediastudios_-_office_drone.obj", "../02-icy-february/assets/", "Drone_Skin_Drone",
+                     VertexFormat::Packed, &_boxShader);
+    _assets.LoadMesh(_fridge, "../02-icy-february/assets/fridge.obj", "../02-icy-february/assets/", "Cube",
+                     VertexFormat::Packed, &_boxShader);
+
+    // All created objects are drawn as scaled cubes in a single instanced call
+    _propShader.compileDefaultInstancedShader();
+    _props.cubeTriangles()
+        .setup(&_propShader);
+    _props.setupInstances(&_propShader);
+
+    _physics.InitDebugDraw();
+
+    CreationObject::_shader.compileDefaultShader();
+
+    return true;
+}
+
+bool IcyFebruary::SetupSimulation()
+{
     _floorObject = PhysicsObjectBuilder(_physics)
                        .Box(glm::vec3(40.0f, 20.0f, 0.1f))
                        .Mass(0.0f)
@@ -147,16 +205,6 @@ bool IcyFebruary::Setup()
         .Mass(0.0f)
         .Build();
 
-    _character.loadObj("../02-icy-february/assets/hjmediastudios_-_office_drone.obj", "../02-icy-february/assets/", "Drone_Skin_Drone")
-        .setup(&_boxShader);
-
-    _fridge.loadObj("../02-icy-february/assets/fridge.obj", "../02-icy-february/assets/", "Cube")
-        .setup(&_boxShader);
-
-    _physics.InitDebugDraw();
-
-    CreationObject::_shader.compileDefaultShader();
-
     return true;
 }
 
@@ -177,6 +225,23 @@ void IcyFebruary::Update(int dt)
         return;
     }
 
+    // Objects created from the UI are added here, the UI may run on another thread
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+
+        for (auto obj : _pendingObjects)
+        {
+            obj->_object = PhysicsObjectBuilder(_physics)
+                               .Box(obj->_size * 2.0f)
+                               .InitialPosition(obj->_pos)
+                               .Mass(0.0f)
+                               .Build();
+
+            _createdObjects.push_back(obj);
+        }
+        _pendingObjects.clear();
+    }
+
     if (_userInput.ActionState(UserInputActions::SpeedUp))
     {
         _characterObject->Forward(1.0f);
@@ -216,37 +281,127 @@ void IcyFebruary::Update(int dt)
 
     _characterObject->Update();
 
-    _physics.Step(dt / 1000.0f);
+    auto &frame = _frames.WriteBuffer();
 
-    _pos.x = _characterObject->getMatrix()[3].x;
-    _view = glm::lookAt(_pos + glm::vec3(_camOffset[0], _camOffset[1], _camOffset[2]), _pos, glm::vec3(0.0f, 0.0f, 1.0f));
+    frame._lastStep = _physics.Step(dt / 1000.0f);
+
+    // Physics runs at a fixed rate, blend the last two steps so rendering at
+    // any other rate does not judder
+    frame._characterMatrix = _characterObject->getInterpolatedMatrix(_physics.InterpolationAlpha());
+
+    // Culling walks the broadphase tree, so it has to happen here next to
+    // the step and not in Render()
+    bool hasCullMatrix;
+    glm::mat4 cullMatrix;
+    glm::vec3 cullPosition;
+    PhysicsManager::DebugDrawOptions debugOptions;
+    {
+        std::lock_guard<std::mutex> lock(_cullMutex);
+
+        hasCullMatrix = _hasCullMatrix;
+        cullMatrix = _cullMatrix;
+        cullPosition = _cullPosition;
+        debugOptions = _cullDebugOptions;
+    }
+
+    if (hasCullMatrix)
+    {
+        _physics.QueryFrustum(cullMatrix, _visibleHandles);
+        _physics.SetDebugCamera(cullPosition, cullMatrix);
+    }
+
+    if (_collectPhysicsDebug)
+    {
+        _physics.SetDebugOptions(debugOptions);
+        _physics.CollectDebugLines(frame._debugLines);
+    }
+    else
+    {
+        frame._debugLines.clear();
+    }
+
+    auto isVisible = [&](PhysicsObject *obj) {
+        return !hasCullMatrix || std::binary_search(_visibleHandles.begin(), _visibleHandles.end(), obj->getHandle());
+    };
+
+    frame._propMatrices.clear();
+    for (auto obj : _createdObjects)
+    {
+        if (isVisible(obj->_object))
+        {
+            frame._propMatrices.push_back(obj->_object->getMatrix() * glm::scale(glm::mat4(1.0f), obj->_size * 2.0f));
+        }
+    }
+    frame._propCount = int(_createdObjects.size());
+
+    _frames.Publish();
 }
 
 static ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
 void IcyFebruary::Render()
 {
+    _frames.Consume();
+    auto &frame = _frames.ReadBuffer();
+    auto &characterMatrix = frame._characterMatrix;
+
+    _pos.x = characterMatrix[3].x;
+    _view = glm::lookAt(_pos + glm::vec3(_camOffset[0], _camOffset[1], _camOffset[2]), _pos, glm::vec3(0.0f, 0.0f, 1.0f));
+
+    _assets.DrainUploads(ASSET_UPLOAD_BUDGET_MS);
+
+    // Projection and view go to all shaders through the frame uniforms, draws
+    // only set their model matrix
+    _frameUniforms.update(_proj, _view);
+
     glViewport(0, 0, _width, _height);
 
     glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear Screen And Depth Buffer
+
+    {
+        std::lock_guard<std::mutex> lock(_cullMutex);
+
+        _cullMatrix = _proj * _view;
+        _cullPosition = _pos + glm::vec3(_camOffset[0], _camOffset[1], _camOffset[2]);
+        _cullDebugOptions = _debugOptions;
+        _hasCullMatrix = true;
+    }
+
+    _visibleCount = 0;
+    _renderableCount = 2 + frame._propCount;
+
+    // The props were culled by Update(). The drone and the fridge are tested
+    // here with their mesh bounds, the drone sticks out of its physics capsule.
+    Frustum frustum(_proj * _view);
+    _renderQueue.Begin(_view);
+    if (_character.vertexArrayId() != 0 && frustum.IntersectsAabb(Frustum::TransformAabb(characterMatrix, {_character.boundsMin(), _character.boundsMax()})))
+    {
+        _renderQueue.Add(&_boxShader, &_character, characterMatrix, RenderFlagsClockwise);
+        _visibleCount++;
+    }
+    if (_fridge.vertexArrayId() != 0 && frustum.IntersectsAabb(Frustum::TransformAabb(glm::mat4(1.0f), {_fridge.boundsMin(), _fridge.boundsMax()})))
+    {
+        _renderQueue.Add(&_boxShader, &_fridge, glm::mat4(1.0f), RenderFlagsClockwise);
+        _visibleCount++;
+    }
+
+    _visibleCount += int(frame._propMatrices.size());
+    if (!frame._propMatrices.empty())
+    {
+        _props.updateInstances(frame._propMatrices);
+        _renderQueue.AddInstanced(&_propShader, &_props);
+    }
+
     {
         CapabilityGuard depthTest(GL_DEPTH_TEST, true);
-        // Select shader
-        _boxShader.use();
-
-        glFrontFace(GL_CW);
-        _boxShader.setupMatrices(_proj, _view, _characterObject->getMatrix());
-        _character.render();
-        _boxShader.setupMatrices(_proj, _view, glm::mat4(1.0f));
-        _fridge.render();
-        glFrontFace(GL_CCW);
+        _renderQueue.Submit(_proj);
     }
 
     if (_showPhysicsDebug)
     {
         CapabilityGuard depthTest(GL_DEPTH_TEST, false);
-        _physics.DebugDraw(_proj, _view);
+        _physics.DebugDraw(frame._debugLines, _proj, _view);
     }
 
     if (_create != nullptr)
@@ -285,6 +440,29 @@ void IcyFebruary::RenderUi()
             ImGui::SliderFloat("Cam Y", &(_camOffset[1]), -30.0f, 30.0f);
             ImGui::SliderFloat("Cam Z", &(_camOffset[2]), -30.0f, 30.0f);
             ImGui::Checkbox("Show Physics Debug", &_showPhysicsDebug);
+            _collectPhysicsDebug = _showPhysicsDebug;
+
+            if (_showPhysicsDebug)
+            {
+                auto modeCheckbox = [this](char const *label, int mode) {
+                    bool enabled = (_debugOptions._modes & mode) != 0;
+                    if (ImGui::Checkbox(label, &enabled))
+                    {
+                        _debugOptions._modes = enabled ? (_debugOptions._modes | mode) : (_debugOptions._modes & ~mode);
+                    }
+                };
+
+                modeCheckbox("Wireframe", btIDebugDraw::DBG_DrawWireframe);
+                modeCheckbox("Bounding boxes", btIDebugDraw::DBG_DrawAabb);
+                modeCheckbox("Contact points", btIDebugDraw::DBG_DrawContactPoints);
+                modeCheckbox("Constraints", btIDebugDraw::DBG_DrawConstraints);
+                modeCheckbox("Normals", btIDebugDraw::DBG_DrawNormals);
+
+                // Zero turns a distance limit off
+                ImGui::Checkbox("Only in view", &_debugOptions._cullToFrustum);
+                ImGui::SliderFloat("Detail distance", &_debugOptions._detailDistance, 0.0f, 200.0f);
+                ImGui::SliderFloat("Max distance", &_debugOptions._maxDistance, 0.0f, 500.0f);
+            }
 
             if (_create != nullptr)
             {
@@ -305,13 +483,9 @@ void IcyFebruary::RenderUi()
                 {
                     if (ImGui::Button("Create"))
                     {
-                        PhysicsObjectBuilder(_physics)
-                            .Box(_create->_size * 2.0f)
-                            .InitialPosition(_create->_pos)
-                            .Mass(0.0f)
-                            .Build();
+                        std::lock_guard<std::mutex> lock(_pendingMutex);
 
-                        _createdObjects.push_back(_create);
+                        _pendingObjects.push_back(_create);
                         _create = nullptr;
                     }
                 }
@@ -349,6 +523,13 @@ void IcyFebruary::RenderUi()
                 }
 
                 ImGui::Text("%.1f FPS", ImGui::GetIO().Framerate);
+                auto &frame = _frames.ReadBuffer();
+                ImGui::Text("%d physics steps, %.1f ms dropped", frame._lastStep._subSteps, frame._lastStep._droppedTime * 1000.0f);
+                ImGui::Text("%d of %d objects visible", _visibleCount, _renderableCount);
+                if (_assets.PendingCount() > 0)
+                {
+                    ImGui::Text("Loading %d assets", _assets.PendingCount());
+                }
             }
             if (_menuMode == MenuModes::KeyMappingMenu)
             {
@@ -403,4 +584,5 @@ void IcyFebruary::RenderUi()
 
 void IcyFebruary::Destroy()
 {
+    _assets.Stop();
 }
@@ -7,8 +7,15 @@
 #include "game.h"
 #include "gl-color-normal-position-vertex.h"
 #include "physics.h"
+#include <assetmanager.h>
+#include <frustum.h>
 #include <gl-color-position-vertex.h>
+#include <gl-frame-uniforms.h>
+#include <renderqueue.h>
+#include <triplebuffer.h>
 
+#include <atomic>
+#include <mutex>
 #include <string>
 
 enum class MenuModes
@@ -21,8 +28,11 @@ enum class MenuModes
 class CreationObject
 {
 public:
+    CreationObject();
+
     glm::vec3 _pos;
     glm::vec3 _size;
+    PhysicsObject *_object;
 
     void rebuildBuffer();
 
@@ -30,32 +40,72 @@ public:
     ColorPosition::BufferType _buffer;
 };
 
+// Everything Render() needs from the simulation, written by Update() and
+// handed over through a triple buffer so both can run on their own thread
+class FrameSnapshot
+{
+public:
+    FrameSnapshot();
+
+    glm::mat4 _characterMatrix;
+    PhysicsManager::StepResult _lastStep;
+    std::vector<ColorPosition::VertexType> _debugLines;
+    std::vector<glm::mat4> _propMatrices; // only the props in view
+    int _propCount;
+};
+
 class IcyFebruary : public Game
 {
     bool _showPhysicsDebug;
+    std::atomic<bool> _collectPhysicsDebug;
     glm::mat4 _proj, _view;
     glm::vec3 _pos;
 
     std::string _settingsDir;
-    MenuModes _menuMode;
+    std::atomic<MenuModes> _menuMode;
+
+    TripleBuffer<FrameSnapshot> _frames;
+    std::mutex _pendingMutex;
+    std::vector<CreationObject *> _pendingObjects;
 
+    // Camera and debug draw settings of the last rendered frame, Update()
+    // culls against them
+    std::mutex _cullMutex;
+    glm::mat4 _cullMatrix;
+    glm::vec3 _cullPosition;
+    PhysicsManager::DebugDrawOptions _cullDebugOptions;
+    bool _hasCullMatrix;
+    std::vector<PhysicsObjectHandle> _visibleHandles;
+
+    FrameUniformBuffer _frameUniforms;
     ShaderType _boxShader;
     float _camOffset[3];
 
     PhysicsManager _physics;
+    PhysicsManager::DebugDrawOptions _debugOptions;
     PhysicsObject *_floorObject;
     BufferType _character;
     CharacterObject *_characterObject;
     BufferType _fridge;
+    ShaderType _propShader;
+    BufferType _props;
+    int _visibleCount;
+    int _renderableCount;
+    RenderQueue _renderQueue;
     CreationObject *_create;
     std::vector<CreationObject *> _createdObjects;
 
+    // Meshes load on the asset workers and Render() uploads them.
+    // Declared last so the workers are stopped before the buffers they fill go.
+    AssetManager _assets;
+
     unsigned int uploadTexture(std::string const &filename);
 
 public:
     IcyFebruary(int argc, char *argv[]);
 
     virtual bool Setup();
+    virtual bool SetupSimulation();
     virtual void Resize(int width, int height);
     virtual void Update(int dt);
     virtual void RenderUi();
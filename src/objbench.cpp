@@ -0,0 +1,281 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+#define OBJPARALLEL_IMPLEMENTATION
+#include <objparallel.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Times tinyobj::LoadObj() against ObjParallel::LoadObj() on one file for a
+// number of thread counts, and checks both return the same shapes.
+//
+// usage: obj-bench [--threads 1,2,4,...] [--runs N] [--generate MB] FILE
+//
+// With --generate a synthetic mesh of about MB megabytes is written to FILE
+// first, a few hundred MB shows the difference well.
+
+struct LoadResult
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    bool ok;
+    double ms;
+};
+
+// A grid of quads split in a few groups, with normals, texcoords and some
+// relative indices so every path of the loader is used
+static bool generate(std::string const &filename, size_t megabytes)
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        std::cerr << "could not open \"" << filename << "\" for writing" << std::endl;
+        return false;
+    }
+
+    const size_t target = megabytes * 1024 * 1024;
+    const int side = 256;
+    size_t written = 0;
+    long long vertexBase = 0;
+    int tile = 0;
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(6);
+
+    while (written < target)
+    {
+        ss.str("");
+        ss << "g tile" << tile << "\n";
+
+        for (int y = 0; y <= side; y++)
+        {
+            for (int x = 0; x <= side; x++)
+            {
+                float fx = float(x) / side, fy = float(y) / side;
+                ss << "v " << fx + tile << " " << fy << " " << 0.1f * std::sin(fx * 10.0f + tile) << "\n";
+                ss << "vn 0.000000 0.000000 1.000000\n";
+                ss << "vt " << fx << " " << fy << "\n";
+            }
+        }
+
+        for (int y = 0; y < side; y++)
+        {
+            for (int x = 0; x < side; x++)
+            {
+                long long a = vertexBase + y * (side + 1) + x + 1;
+                long long b = a + 1, c = a + side + 2, d = a + side + 1;
+
+                if ((x + y) % 7 == 0)
+                {
+                    // relative to the end of the vertex list
+                    long long count = vertexBase + (side + 1) * (side + 1);
+                    a -= count + 1;
+                    b -= count + 1;
+                    c -= count + 1;
+                    d -= count + 1;
+                }
+
+                ss << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " "
+                   << c << "/" << c << "/" << c << " " << d << "/" << d << "/" << d << "\n";
+            }
+        }
+
+        auto text = ss.str();
+        out.write(text.data(), std::streamsize(text.size()));
+        written += text.size();
+
+        vertexBase += (side + 1) * (side + 1);
+        tile++;
+    }
+
+    return out.good();
+}
+
+template <class Load>
+static void timeLoad(LoadResult &result, int runs, Load load)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result.ms = 0.0;
+    for (int run = 0; run < runs; run++)
+    {
+        result.attrib = tinyobj::attrib_t();
+        result.shapes.clear();
+        result.materials.clear();
+
+        auto start = Clock::now();
+        result.ok = load(result);
+        auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        result.ms = (run == 0) ? ms : std::min(result.ms, ms);
+    }
+}
+
+static bool sameIndex(tinyobj::index_t const &a, tinyobj::index_t const &b)
+{
+    return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+}
+
+static bool sameResult(LoadResult const &a, LoadResult const &b)
+{
+    if (a.ok != b.ok ||
+        a.attrib.vertices != b.attrib.vertices ||
+        a.attrib.normals != b.attrib.normals ||
+        a.attrib.texcoords != b.attrib.texcoords ||
+        a.attrib.colors != b.attrib.colors ||
+        a.shapes.size() != b.shapes.size() ||
+        a.materials.size() != b.materials.size())
+    {
+        return false;
+    }
+
+    for (size_t s = 0; s < a.shapes.size(); s++)
+    {
+        auto const &ma = a.shapes[s].mesh;
+        auto const &mb = b.shapes[s].mesh;
+
+        if (a.shapes[s].name != b.shapes[s].name ||
+            ma.num_face_vertices != mb.num_face_vertices ||
+            ma.material_ids != mb.material_ids ||
+            ma.indices.size() != mb.indices.size() ||
+            !std::equal(ma.indices.begin(), ma.indices.end(), mb.indices.begin(), sameIndex))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static std::vector<int> parseList(char const *list)
+{
+    std::vector<int> result;
+
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        result.push_back(atoi(item.c_str()));
+    }
+
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> threads = {1, 2, 4, 8, 0};
+    int runs = 3;
+    size_t generateMegabytes = 0;
+    std::string filename;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = parseList(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+        {
+            runs = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc)
+        {
+            generateMegabytes = size_t(atoi(argv[++i]));
+        }
+        else
+        {
+            filename = argv[i];
+        }
+    }
+
+    if (filename.empty())
+    {
+        std::cerr << "usage: obj-bench [--threads 1,2,4,...] [--runs N] [--generate MB] FILE" << std::endl;
+        return 1;
+    }
+
+    if (generateMegabytes > 0 && !generate(filename, generateMegabytes))
+    {
+        return 1;
+    }
+
+    std::string baseDir;
+    auto slash = filename.find_last_of("/\\");
+    if (slash != std::string::npos)
+    {
+        baseDir = filename.substr(0, slash + 1);
+    }
+
+    LoadResult reference;
+    timeLoad(reference, runs, [&](LoadResult &result) {
+        std::string err;
+        return tinyobj::LoadObj(&result.attrib, &result.shapes, &result.materials, &err, filename.c_str(), baseDir.c_str());
+    });
+
+    if (!reference.ok)
+    {
+        std::cerr << "tinyobj::LoadObj failed for \"" << filename << "\"" << std::endl;
+        return 1;
+    }
+
+    size_t faces = 0;
+    for (auto const &shape : reference.shapes)
+    {
+        faces += shape.mesh.num_face_vertices.size();
+    }
+
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    double megabytes = double(file.tellg()) / (1024.0 * 1024.0);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << filename << ": " << megabytes << " MB, "
+              << reference.attrib.vertices.size() / 3 << " vertices, "
+              << faces << " faces, " << reference.shapes.size() << " shapes" << std::endl;
+
+    std::cout << std::setw(12) << "loader"
+              << std::setw(9) << "threads"
+              << std::setw(12) << "ms"
+              << std::setw(10) << "MB/s"
+              << std::setw(10) << "speedup"
+              << std::setw(8) << "same" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(12) << "tinyobj"
+              << std::setw(9) << 1
+              << std::setw(12) << reference.ms
+              << std::setw(10) << megabytes * 1000.0 / reference.ms
+              << std::setw(10) << 1.0
+              << std::setw(8) << "-" << std::endl;
+
+    bool allSame = true;
+    for (auto threadCount : threads)
+    {
+        LoadResult result;
+        timeLoad(result, runs, [&](LoadResult &result) {
+            std::string err;
+            return ObjParallel::LoadObj(&result.attrib, &result.shapes, &result.materials, &err, filename.c_str(), baseDir.c_str(), true, threadCount);
+        });
+
+        bool same = sameResult(reference, result);
+        allSame = allSame && same;
+
+        std::cout << std::setw(12) << "parallel"
+                  << std::setw(9) << (threadCount > 0 ? std::to_string(threadCount) : std::string("all"))
+                  << std::setw(12) << result.ms
+                  << std::setw(10) << megabytes * 1000.0 / result.ms
+                  << std::setw(10) << reference.ms / result.ms
+                  << std::setw(8) << (same ? "yes" : "NO") << std::endl;
+    }
+
+    return allSame ? 0 : 2;
+}
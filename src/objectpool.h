@@ -0,0 +1,156 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Stores objects in fixed size chunks of slots with a free list, so creating
+// and destroying is O(1) and objects never move once created. Every slot has
+// a generation that goes up on Destroy(), to detect stale indices.
+template <class T, int ChunkSize = 256>
+class ObjectPool
+{
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+        unsigned int _generation;
+        int _nextFree;
+        bool _alive;
+    };
+
+    std::vector<Slot *> _chunks;
+    int _firstFree;
+    int _count;
+
+    Slot &slot(int index)
+    {
+        return _chunks[index / ChunkSize][index % ChunkSize];
+    }
+
+    Slot const &slot(int index) const
+    {
+        return _chunks[index / ChunkSize][index % ChunkSize];
+    }
+
+    void grow()
+    {
+        auto chunk = new Slot[ChunkSize];
+        int base = int(_chunks.size()) * ChunkSize;
+
+        for (int i = 0; i < ChunkSize; i++)
+        {
+            chunk[i]._generation = 0;
+            chunk[i]._alive = false;
+            chunk[i]._nextFree = (i + 1 < ChunkSize) ? base + i + 1 : _firstFree;
+        }
+
+        _firstFree = base;
+        _chunks.push_back(chunk);
+    }
+
+public:
+    ObjectPool()
+        : _firstFree(-1), _count(0)
+    {}
+
+    ObjectPool(ObjectPool const &) = delete;
+    ObjectPool &operator=(ObjectPool const &) = delete;
+
+    virtual ~ObjectPool()
+    {
+        for (int i = 0; i < Capacity(); i++)
+        {
+            Destroy(i);
+        }
+
+        for (auto chunk : _chunks)
+        {
+            delete[] chunk;
+        }
+        _chunks.clear();
+    }
+
+    template <class... Args>
+    int Create(Args &&... args)
+    {
+        if (_firstFree < 0)
+        {
+            grow();
+        }
+
+        int index = _firstFree;
+        auto &s = slot(index);
+
+        new (&s._storage) T(std::forward<Args>(args)...);
+        _firstFree = s._nextFree;
+        s._alive = true;
+        _count++;
+
+        return index;
+    }
+
+    void Destroy(int index)
+    {
+        if (!IsAlive(index))
+        {
+            return;
+        }
+
+        auto &s = slot(index);
+
+        reinterpret_cast<T *>(&s._storage)->~T();
+        s._alive = false;
+        s._generation++;
+        s._nextFree = _firstFree;
+        _firstFree = index;
+        _count--;
+    }
+
+    bool IsAlive(int index) const
+    {
+        return index >= 0 && index < Capacity() && slot(index)._alive;
+    }
+
+    unsigned int Generation(int index) const
+    {
+        return slot(index)._generation;
+    }
+
+    T *Get(int index)
+    {
+        if (!IsAlive(index))
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<T *>(&slot(index)._storage);
+    }
+
+    int Count() const
+    {
+        return _count;
+    }
+
+    int Capacity() const
+    {
+        return int(_chunks.size()) * ChunkSize;
+    }
+
+    // Calls function(index, object) for every live object, the function may
+    // destroy the object it is given
+    template <class Function>
+    void ForEach(Function function)
+    {
+        for (int i = 0; i < Capacity(); i++)
+        {
+            if (slot(i)._alive)
+            {
+                function(i, *reinterpret_cast<T *>(&slot(i)._storage));
+            }
+        }
+    }
+};
+
+#endif // OBJECTPOOL_H
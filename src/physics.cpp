@@ -1,28 +1,130 @@
 #include "physics.h"
+#include "physicsobjectimpl.h"
+#include <algorithm>
+#include <frustum.h>
+#include <cmath>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <vector>
 
+#ifdef BT_THREADSAFE
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <LinearMath/btThreads.h>
+#endif
+
 using namespace std;
 
-PhysicsManager::Config PhysicsManager::_config = {9.81f};
+const PhysicsManager::Config PhysicsManager::DefaultConfig = {9.81f, 1.0f / 60.0f, 5, 0.25f};
+
+#ifdef BT_THREADSAFE
+
+// Bullet has one task scheduler per process, so all threaded managers share
+// it. The first of them creates and sizes it, the ones made while it lives get
+// the same thread count, and it goes with the last of them. Resizing it under
+// a living manager would leave that manager with a solver pool of the old size.
+static btITaskScheduler *sharedScheduler = nullptr;
+static int sharedSchedulerUsers = 0;
+
+static btITaskScheduler *acquireScheduler(int workerCount)
+{
+    if (sharedSchedulerUsers++ == 0)
+    {
+        sharedScheduler = btCreateDefaultTaskScheduler();
+        if (sharedScheduler == nullptr)
+        {
+            sharedScheduler = btGetSequentialTaskScheduler();
+        }
+
+        sharedScheduler->setNumThreads(workerCount);
+        btSetTaskScheduler(sharedScheduler);
+    }
+
+    return sharedScheduler;
+}
+
+static void releaseScheduler()
+{
+    if (--sharedSchedulerUsers > 0)
+    {
+        return;
+    }
+
+    btSetTaskScheduler(nullptr);
+
+    // The sequential scheduler is a static inside bullet
+    if (sharedScheduler != btGetSequentialTaskScheduler())
+    {
+        delete sharedScheduler;
+    }
+    sharedScheduler = nullptr;
+}
+
+#endif
 
-PhysicsManager::PhysicsManager()
-    : _drawer(nullptr)
+PhysicsManager::PhysicsManager(int workerCount)
+    : _solverPool(nullptr), _workerCount(0), _config(DefaultConfig), _drawer(nullptr), _hasDebugCamera(false), _debugCameraPosition(0.0f), _debugCameraMatrix(1.0f),
+      _store(new PhysicsObjectStore()), _accumulator(0.0f), _stepCount(0)
 {
+    this->_debugOptions._modes = btIDebugDraw::DBG_DrawWireframe + btIDebugDraw::DBG_DrawConstraints + btIDebugDraw::DBG_DrawNormals;
+    this->_debugOptions._cullToFrustum = false;
+    this->_debugOptions._detailDistance = 0.0f;
+    this->_debugOptions._maxDistance = 0.0f;
+
+    this->_contacts.reserve(1024);
+    this->_previousContacts.reserve(1024);
+    this->_collisionEvents.reserve(1024);
+
     this->_broadphase = new btDbvtBroadphase();
 
     this->_collisionConfiguration = new btDefaultCollisionConfiguration();
-    this->_dispatcher = new btCollisionDispatcher(this->_collisionConfiguration);
 
-    this->_solver = new btSequentialImpulseConstraintSolver();
+#ifdef BT_THREADSAFE
+    if (workerCount > 0)
+    {
+        auto scheduler = acquireScheduler(workerCount);
+
+        this->_workerCount = scheduler->getNumThreads();
+
+        this->_dispatcher = new btCollisionDispatcherMt(this->_collisionConfiguration);
+
+        auto solverPool = new btConstraintSolverPoolMt(this->_workerCount);
+        this->_solverPool = solverPool;
+        this->_solver = new btSequentialImpulseConstraintSolverMt();
+
+        this->_dynamicsWorld = new btDiscreteDynamicsWorldMt(this->_dispatcher, this->_broadphase, solverPool, this->_solver, this->_collisionConfiguration);
+    }
+    else
+#endif
+    {
+        if (workerCount > 0)
+        {
+            std::cerr << "bullet is built without BT_THREADSAFE, using a single threaded world" << std::endl;
+        }
+
+        this->_dispatcher = new btCollisionDispatcher(this->_collisionConfiguration);
+
+        this->_solver = new btSequentialImpulseConstraintSolver();
+
+        this->_dynamicsWorld = new btDiscreteDynamicsWorld(this->_dispatcher, this->_broadphase, this->_solver, this->_collisionConfiguration);
+    }
 
-    this->_dynamicsWorld = new btDiscreteDynamicsWorld(this->_dispatcher, this->_broadphase, this->_solver, this->_collisionConfiguration);
-    this->_dynamicsWorld->setGravity(btVector3(0, 0, -PhysicsManager::_config._gravity));
+    this->_dynamicsWorld->setGravity(btVector3(0, 0, -this->_config._gravity));
 }
 
 PhysicsManager::~PhysicsManager()
 {
+    if (this->_store != nullptr)
+    {
+        this->_store->_objects.ForEach([this](int, ImplPhysicsObject &obj) { destroyObject(&obj); });
+        this->_store->_characters.ForEach([this](int, CharacterPhysicsObject &obj) { destroyObject(&obj); });
+        this->_store->_cars.ForEach([this](int, CarPhysicsObject &obj) { destroyObject(&obj); });
+
+        delete this->_store;
+    }
+    this->_store = nullptr;
+
     if (this->_dynamicsWorld != 0)
         delete this->_dynamicsWorld;
     this->_dynamicsWorld = 0;
@@ -31,6 +133,10 @@ PhysicsManager::~PhysicsManager()
         delete this->_solver;
     this->_solver = 0;
 
+    if (this->_solverPool != 0)
+        delete this->_solverPool;
+    this->_solverPool = 0;
+
     if (this->_dispatcher != 0)
         delete this->_dispatcher;
     this->_dispatcher = 0;
@@ -42,33 +148,218 @@ PhysicsManager::~PhysicsManager()
     if (this->_broadphase != 0)
         delete this->_broadphase;
     this->_broadphase = 0;
+
+#ifdef BT_THREADSAFE
+    if (this->_workerCount > 0)
+        releaseScheduler();
+    this->_workerCount = 0;
+#endif
 }
 
-void PhysicsManager::Step(float gameTime)
+PhysicsManager::StepResult PhysicsManager::Step(float gameTime)
 {
-    this->_dynamicsWorld->stepSimulation(1.0f/60.0f, 1);
-    int numManifolds = this->_dynamicsWorld->getDispatcher()->getNumManifolds();
+    StepResult result = {0, 0.0f};
+
+    // Events are kept for one Step(), read them before the next one
+    this->_collisionEvents.clear();
+
+    if (gameTime < 0.0f)
+    {
+        gameTime = 0.0f;
+    }
+
+    // Clamp long frames (breakpoints, window drags, loading hitches) so we
+    // never try to catch up more than _maxFrameTime worth of simulation
+    if (gameTime > _config._maxFrameTime)
+    {
+        result._droppedTime += gameTime - _config._maxFrameTime;
+        gameTime = _config._maxFrameTime;
+    }
+
+    this->_accumulator += gameTime;
+
+    while (this->_accumulator >= _config._fixedTimeStep && result._subSteps < _config._maxSubSteps)
+    {
+        // With maxSubSteps set to 0 bullet does exactly one step of the given size,
+        // the accumulating is done here so we know what happened to the time.
+        // The step count goes up first so motion states can tag their update with it
+        this->_stepCount++;
+        this->_dynamicsWorld->stepSimulation(_config._fixedTimeStep, 0);
+        this->_accumulator -= _config._fixedTimeStep;
+        result._subSteps++;
+
+        // Pairs are gathered over all substeps, so a contact that starts and
+        // stops between two of them still shows up
+        if (result._subSteps == 1)
+        {
+            this->_contacts.swap(this->_previousContacts);
+            this->_contacts.clear();
+        }
+        collectContacts();
+    }
+
+    if (result._subSteps > 0)
+    {
+        diffContacts();
+    }
+
+    // Out of substeps: drop whatever is left over a single step so the next
+    // frame does not start behind (spiral of death)
+    if (this->_accumulator >= _config._fixedTimeStep)
+    {
+        float keep = std::fmod(this->_accumulator, _config._fixedTimeStep);
+        result._droppedTime += this->_accumulator - keep;
+        this->_accumulator = keep;
+    }
+
+    return result;
+}
+
+void PhysicsManager::collectContacts()
+{
+    auto dispatcher = this->_dynamicsWorld->getDispatcher();
+    int numManifolds = dispatcher->getNumManifolds();
 
     for (int i = 0; i < numManifolds; i++)
     {
-        btPersistentManifold *contactManifold = this->_dynamicsWorld->getDispatcher()->getManifoldByIndexInternal(i);
+        btPersistentManifold *contactManifold = dispatcher->getManifoldByIndexInternal(i);
 
         if (contactManifold->getNumContacts() <= 0) continue;
 
-        if (contactManifold->getBody0()->getUserPointer() == nullptr) continue;
-        if (contactManifold->getBody1()->getUserPointer() == nullptr) continue;
+        auto objA = static_cast<ImplPhysicsObject *>(contactManifold->getBody0()->getUserPointer());
+        if (objA == nullptr) continue;
+
+        auto objB = static_cast<ImplPhysicsObject *>(contactManifold->getBody1()->getUserPointer());
+        if (objB == nullptr) continue;
+
+        ContactPair pair = {objA->_handle, objB->_handle};
+        if (pair._b < pair._a)
+        {
+            std::swap(pair._a, pair._b);
+        }
+
+        this->_contacts.push_back(pair);
+    }
+}
+
+void PhysicsManager::diffContacts()
+{
+    // Compound shapes and substeps can give more than one manifold for the same pair
+    std::sort(this->_contacts.begin(), this->_contacts.end());
+    this->_contacts.erase(std::unique(this->_contacts.begin(), this->_contacts.end()), this->_contacts.end());
+
+    // Both lists are sorted, so one merge pass tells what began, persisted and ended
+    size_t p = 0, c = 0;
+    while (p < this->_previousContacts.size() || c < this->_contacts.size())
+    {
+        if (c == this->_contacts.size() || (p < this->_previousContacts.size() && this->_previousContacts[p] < this->_contacts[c]))
+        {
+            auto &pair = this->_previousContacts[p++];
+            this->_collisionEvents.push_back(CollisionEvent({CollisionEventType::End, pair._a, pair._b}));
+        }
+        else if (p == this->_previousContacts.size() || this->_contacts[c] < this->_previousContacts[p])
+        {
+            auto &pair = this->_contacts[c++];
+            this->_collisionEvents.push_back(CollisionEvent({CollisionEventType::Begin, pair._a, pair._b}));
+        }
+        else
+        {
+            auto &pair = this->_contacts[c++];
+            p++;
+            this->_collisionEvents.push_back(CollisionEvent({CollisionEventType::Persist, pair._a, pair._b}));
+        }
+    }
+}
+
+std::vector<CollisionEvent> const &PhysicsManager::CollisionEvents() const
+{
+    return _collisionEvents;
+}
+
+float PhysicsManager::FixedTimeStep() const
+{
+    return _config._fixedTimeStep;
+}
+
+void PhysicsManager::SetFixedTimeStep(float timeStep)
+{
+    if (timeStep <= 0.0f)
+    {
+        return;
+    }
+
+    _config._fixedTimeStep = timeStep;
+}
+
+int PhysicsManager::MaxSubSteps() const
+{
+    return _config._maxSubSteps;
+}
+
+void PhysicsManager::SetMaxSubSteps(int subSteps)
+{
+    if (subSteps < 1)
+    {
+        return;
+    }
+
+    _config._maxSubSteps = subSteps;
+}
+
+float PhysicsManager::MaxFrameTime() const
+{
+    return _config._maxFrameTime;
+}
+
+void PhysicsManager::SetMaxFrameTime(float frameTime)
+{
+    if (frameTime <= 0.0f)
+    {
+        return;
+    }
+
+    _config._maxFrameTime = frameTime;
+}
+
+unsigned int PhysicsManager::StepCount() const
+{
+    return _stepCount;
+}
+
+float PhysicsManager::InterpolationAlpha() const
+{
+    return glm::clamp(_accumulator / _config._fixedTimeStep, 0.0f, 1.0f);
+}
 
-        //        auto entityA = static_cast<GameObject *>(contactManifold->getBody0()->getUserPointer());
-        //        if (entityA == nullptr) continue;
+int PhysicsManager::OverlappingPairCount() const
+{
+    return this->_broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+}
 
-        //        auto entityB = static_cast<GameObject *>(contactManifold->getBody1()->getUserPointer());
-        //        if (entityB == nullptr) continue;
+int PhysicsManager::ContactManifoldCount() const
+{
+    int result = 0;
+    int numManifolds = this->_dynamicsWorld->getDispatcher()->getNumManifolds();
 
-        //        for (auto handler : this->_collisionHandlers)
-        //            handler->handleCollision(entityA, entityB);
-        //        this->_collisionHandlers->handleCollision(entityA, entityB);
-        //        contactManifold->clearManifold();
+    for (int i = 0; i < numManifolds; i++)
+    {
+        if (this->_dynamicsWorld->getDispatcher()->getManifoldByIndexInternal(i)->getNumContacts() > 0)
+        {
+            result++;
+        }
     }
+
+    return result;
+}
+
+int PhysicsManager::WorkerCount() const
+{
+    return _workerCount;
+}
+
+int PhysicsManager::ObjectCount() const
+{
+    return this->_dynamicsWorld->getNumCollisionObjects();
 }
 
 void PhysicsManager::AddObject(PhysicsObject *obj, short group, short mask)
@@ -81,6 +372,43 @@ void PhysicsManager::AddObject(PhysicsObject *obj, short group, short mask)
     this->_dynamicsWorld->addRigidBody(obj->getRigidBody(), group, mask);
 }
 
+std::vector<PhysicsObject *> PhysicsManager::BuildObjects(std::vector<PhysicsObjectBuilder> const &builders, bool optimizeTree)
+{
+    std::vector<PhysicsObject *> result;
+    result.reserve(builders.size());
+
+    auto &objects = this->_dynamicsWorld->getCollisionObjectArray();
+    objects.reserve(objects.size() + int(builders.size()));
+
+    // With deferred collide the broadphase skips the tree query it normally
+    // does for every new proxy, the pairs are found by the collide pass below
+    bool deferedCollide = this->_broadphase->m_deferedcollide;
+    this->_broadphase->m_deferedcollide = true;
+
+    for (auto &builder : builders)
+    {
+        auto obj = builder.createObject();
+
+        if (obj != nullptr)
+        {
+            AddObject(obj);
+        }
+
+        result.push_back(obj);
+    }
+
+    if (optimizeTree)
+    {
+        this->_broadphase->m_sets[0].optimizeTopDown();
+        this->_broadphase->m_sets[1].optimizeTopDown();
+    }
+
+    this->_broadphase->calculateOverlappingPairs(this->_dispatcher);
+    this->_broadphase->m_deferedcollide = deferedCollide;
+
+    return result;
+}
+
 void PhysicsManager::RemoveObject(PhysicsObject *obj)
 {
     if (obj == nullptr)
@@ -90,3 +418,101 @@ void PhysicsManager::RemoveObject(PhysicsObject *obj)
 
     this->_dynamicsWorld->removeCollisionObject(obj->getRigidBody());
 }
+
+// Gathers the collision objects of the leaves collideKDOP() reports as inside
+class FrustumCollector : public btDbvt::ICollide
+{
+    std::vector<btCollisionObject *> &_objects;
+
+public:
+    FrustumCollector(std::vector<btCollisionObject *> &objects)
+        : _objects(objects)
+    {}
+
+    virtual void Process(const btDbvtNode *leaf)
+    {
+        auto proxy = static_cast<btDbvtProxy *>(leaf->data);
+
+        _objects.push_back(static_cast<btCollisionObject *>(proxy->m_clientObject));
+    }
+};
+
+void PhysicsManager::queryFrustum(glm::mat4 const &projectionView, std::vector<btCollisionObject *> &objects) const
+{
+    objects.clear();
+
+    // Both use inward facing planes where n.x + d >= 0 is inside
+    Frustum frustum(projectionView);
+
+    btVector3 normals[Frustum::PlaneCount];
+    btScalar offsets[Frustum::PlaneCount];
+    for (int i = 0; i < Frustum::PlaneCount; i++)
+    {
+        auto plane = frustum.Plane(i);
+        normals[i].setValue(plane.x, plane.y, plane.z);
+        offsets[i] = plane.w;
+    }
+
+    // The broadphase keeps dynamic and static proxies in separate trees
+    FrustumCollector collector(objects);
+    for (int i = 0; i < 2; i++)
+    {
+        btDbvt::collideKDOP(_broadphase->m_sets[i].m_root, normals, offsets, Frustum::PlaneCount, collector);
+    }
+}
+
+void PhysicsManager::QueryFrustum(glm::mat4 const &projectionView, std::vector<PhysicsObjectHandle> &visible)
+{
+    visible.clear();
+
+    queryFrustum(projectionView, _queryObjects);
+
+    for (auto body : _queryObjects)
+    {
+        auto obj = static_cast<ImplPhysicsObject *>(body->getUserPointer());
+        if (obj != nullptr)
+        {
+            visible.push_back(obj->_handle);
+        }
+    }
+
+    std::sort(visible.begin(), visible.end());
+}
+
+PhysicsObject *PhysicsManager::FindObject(PhysicsObjectHandle const &handle)
+{
+    return _store->Find(handle);
+}
+
+void PhysicsManager::DestroyObject(PhysicsObject *obj)
+{
+    if (obj == nullptr)
+    {
+        return;
+    }
+
+    DestroyObject(obj->getHandle());
+}
+
+void PhysicsManager::DestroyObject(PhysicsObjectHandle const &handle)
+{
+    destroyObject(_store->Find(handle));
+}
+
+void PhysicsManager::destroyObject(ImplPhysicsObject *obj)
+{
+    if (obj == nullptr)
+    {
+        return;
+    }
+
+    if (obj->_handle._pool == PhysicsObjectStore::CarPoolId)
+    {
+        static_cast<CarPhysicsObject *>(obj)->RemoveVehicle(this->_dynamicsWorld);
+    }
+
+    this->_dynamicsWorld->removeRigidBody(obj->_rigidBody);
+    this->_shapes.Release(obj->_rigidBody->getCollisionShape());
+
+    _store->Destroy(obj);
+}
@@ -14,36 +14,186 @@
 #include <btBulletDynamicsCommon.h>
 
 #include "physicsobject.h"
+#include "shapecache.h"
+#include <vector>
+
+namespace ColorPosition {
+class VertexType;
+}
+
+enum class CollisionEventType
+{
+    Begin,
+    Persist,
+    End,
+};
+
+class CollisionEvent
+{
+public:
+    CollisionEventType _type;
+    PhysicsObjectHandle _a;
+    PhysicsObjectHandle _b;
+};
 
 class PhysicsManager
 {
     friend class PhysicsObjectBuilder;
 private:
-    btBroadphaseInterface *_broadphase;
+    btDbvtBroadphase *_broadphase;
     btDefaultCollisionConfiguration *_collisionConfiguration;
     btCollisionDispatcher *_dispatcher;
     btSequentialImpulseConstraintSolver *_solver;
+    btConstraintSolver *_solverPool;
     btDiscreteDynamicsWorld *_dynamicsWorld;
+    int _workerCount;
 
-    static struct Config
+    struct Config
     {
         float _gravity;
+        float _fixedTimeStep;
+        int _maxSubSteps;
+        float _maxFrameTime;
 
-    } _config;
+    };
 
+    // Every manager starts from these, the setters only change their own copy
+    static const Config DefaultConfig;
+    Config _config;
+
+public:
+    struct DebugDrawOptions
+    {
+        int _modes;            // btIDebugDraw::DebugDrawModes flags
+        bool _cullToFrustum;   // skip objects outside the debug camera's view
+        float _detailDistance; // further objects are only drawn as their AABB, 0 for no limit
+        float _maxDistance;    // further objects are not drawn at all, 0 for no limit
+    };
+
+private:
     class DebugDrawer *_drawer;
+    DebugDrawOptions _debugOptions;
+    bool _hasDebugCamera;
+    glm::vec3 _debugCameraPosition;
+    glm::mat4 _debugCameraMatrix;
+    std::vector<btCollisionObject *> _queryObjects; // scratch for QueryFrustum() and the debug draw
+    CollisionShapeCache _shapes;
+    class PhysicsObjectStore *_store;
+
+    float _accumulator;
+    unsigned int _stepCount;
+
+    // _a is always the lower handle, so a pair has one order
+    struct ContactPair
+    {
+        PhysicsObjectHandle _a;
+        PhysicsObjectHandle _b;
+
+        bool operator<(ContactPair const &other) const
+        {
+            return _a < other._a || (_a == other._a && _b < other._b);
+        }
+
+        bool operator==(ContactPair const &other) const
+        {
+            return _a == other._a && _b == other._b;
+        }
+    };
+
+    std::vector<ContactPair> _contacts;
+    std::vector<ContactPair> _previousContacts;
+    std::vector<CollisionEvent> _collisionEvents;
+
+    void collectContacts();
+    void diffContacts();
+    void queryFrustum(glm::mat4 const &projectionView, std::vector<btCollisionObject *> &objects) const;
+    void drawDebugWorld();
+
+    void destroyObject(class ImplPhysicsObject *obj);
 
 public:
-    PhysicsManager();
+    struct StepResult
+    {
+        int _subSteps;
+        float _droppedTime;
+    };
+
+    // With a workerCount above 0 the world is a btDiscreteDynamicsWorldMt
+    // stepping on that many threads. This needs bullet and this project to be
+    // built with BT_THREADSAFE (ICY_BULLET_MULTITHREADED in cmake), without it
+    // the manager falls back to the single threaded world.
+    // The thread count is process wide, bullet has one task scheduler that all
+    // threaded managers share. While one of them lives, new ones get its count
+    // whatever they ask for, WorkerCount() tells what a manager really got.
+    explicit PhysicsManager(int workerCount = 0);
     virtual ~PhysicsManager();
 
     void InitDebugDraw();
     void DebugDraw(glm::mat4 const &proj, glm::mat4 const &view);
 
-    void Step(float gameTime);
+    // Split version of DebugDraw for when the world is stepped on another
+    // thread: collect the lines next to Step() and draw them on the GL thread
+    void CollectDebugLines(std::vector<ColorPosition::VertexType> &lines);
+    void DebugDraw(std::vector<ColorPosition::VertexType> const &lines, glm::mat4 const &proj, glm::mat4 const &view);
+
+    // Which parts of the world the debug drawing shows. Distances and culling
+    // are relative to the debug camera and only apply once one is set.
+    DebugDrawOptions const &DebugOptions() const;
+    void SetDebugOptions(DebugDrawOptions const &options);
+    void SetDebugCamera(glm::vec3 const &position, glm::mat4 const &projectionView);
+
+    // Advances the simulation by gameTime seconds in fixed steps of
+    // FixedTimeStep(). Time that does not fit in MaxSubSteps() steps, or
+    // that exceeds MaxFrameTime(), is dropped instead of carried over.
+    StepResult Step(float gameTime);
+
+    // At most one begin, persist or end event per object pair for the last
+    // Step(). A pair touching in any of its substeps counts as touching, a
+    // Step() without substeps reports nothing. Only objects built by
+    // PhysicsObjectBuilder report events, look them up with FindObject().
+    std::vector<CollisionEvent> const &CollisionEvents() const;
+
+    float FixedTimeStep() const;
+    void SetFixedTimeStep(float timeStep);
+    int MaxSubSteps() const;
+    void SetMaxSubSteps(int subSteps);
+    float MaxFrameTime() const;
+    void SetMaxFrameTime(float frameTime);
+    unsigned int StepCount() const;
+
+    // How far the accumulated time is into the next fixed step, between 0 and 1.
+    // Use this to blend between the previous and current transform when rendering.
+    float InterpolationAlpha() const;
+
+    // Statistics of the last step, for benchmarks and debug overlays
+    int OverlappingPairCount() const;
+    int ContactManifoldCount() const;
+    int ObjectCount() const;
+    int WorkerCount() const; // threads of the shared scheduler, 0 when single threaded
 
     void AddObject(PhysicsObject *obj, short group = btBroadphaseProxy::DefaultFilter, short mask = btBroadphaseProxy::DefaultFilter | btBroadphaseProxy::StaticFilter | btBroadphaseProxy::CharacterFilter);
     void RemoveObject(PhysicsObject *obj);
+
+    // Builds the objects described by the builders in one pass, like calling
+    // Build() on each, but without a broadphase pair query per insert. The
+    // pairs are found in one tree against tree pass at the end, optionally
+    // after rebalancing the broadphase trees. Cars and characters are not
+    // supported here, use BuildCar() and BuildCharacter() for those. The
+    // result is in builder order, with nullptr for builders without a shape.
+    std::vector<PhysicsObject *> BuildObjects(std::vector<PhysicsObjectBuilder> const &builders, bool optimizeTree = true);
+
+    // Handles of the objects whose broadphase AABB touches the view frustum of
+    // projectionView, found by walking the broadphase trees instead of
+    // testing every object. The result is sorted, so it can be searched with
+    // std::binary_search. Like Step(), only call this from the physics thread.
+    void QueryFrustum(glm::mat4 const &projectionView, std::vector<PhysicsObjectHandle> &visible);
+
+    // Objects are owned by the manager, destroying removes the object from the
+    // world and gives its memory back to the pool. All objects that are left
+    // are destroyed with the manager.
+    PhysicsObject *FindObject(PhysicsObjectHandle const &handle);
+    void DestroyObject(PhysicsObject *obj);
+    void DestroyObject(PhysicsObjectHandle const &handle);
 };
 
 #endif /* PHYSICS_H */
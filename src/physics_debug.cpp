@@ -1,19 +1,31 @@
 #include "physics.h"
+#include "physicsobjectimpl.h"
 #include <gl-color-position-vertex.h>
 #include <LinearMath/btIDebugDraw.h>
 #include <iostream>
 
 class DebugDrawer : public btIDebugDraw
 {
+    // Room for this many lines is reserved up front, the streaming buffer
+    // and line lists only grow when a frame needs more
+    static const int InitialLineCapacity = 16384;
+
     int _debugMode;
     ColorPosition::ShaderType _shader;
     ColorPosition::BufferType _buffer;
+    std::vector<ColorPosition::VertexType> _lines;
+    std::vector<ColorPosition::VertexType> *_target;
 
 public:
     DebugDrawer();
 
     void init();
     void render(glm::mat4 const &proj, glm::mat4 const &view);
+    void render(std::vector<ColorPosition::VertexType> const &lines, glm::mat4 const &proj, glm::mat4 const &view);
+
+    // Lines go to target until the next call, nullptr means our own list
+    void collectInto(std::vector<ColorPosition::VertexType> *target);
+    std::vector<ColorPosition::VertexType> const &lines() const { return _lines; }
 
     virtual void clearLines();
 
@@ -27,24 +39,45 @@ public:
 };
 
 DebugDrawer::DebugDrawer()
-    : _debugMode(btIDebugDraw::DBG_DrawWireframe + btIDebugDraw::DBG_DrawConstraints + btIDebugDraw::DBG_DrawNormals)
+    : _debugMode(btIDebugDraw::DBG_DrawWireframe + btIDebugDraw::DBG_DrawConstraints + btIDebugDraw::DBG_DrawNormals),
+      _target(&_lines)
 {
     _buffer.setDrawMode(GL_LINES);
+    _lines.reserve(InitialLineCapacity * 2);
+}
+
+void DebugDrawer::collectInto(std::vector<ColorPosition::VertexType> *target)
+{
+    _target = (target != nullptr ? target : &_lines);
+
+    // Cleared lists keep their capacity, so this only allocates the first time
+    _target->reserve(InitialLineCapacity * 2);
 }
 
 void DebugDrawer::clearLines()
 {
-    _buffer.cleanup();
+    _target->clear();
 }
 
 void DebugDrawer::init()
 {
     _shader.compileDefaultShader();
+    _buffer.setupStreaming(&_shader, InitialLineCapacity * 2);
 }
 
 void DebugDrawer::render(glm::mat4 const &proj, glm::mat4 const &view)
 {
-    _buffer.setup(&_shader);
+    render(_lines, proj, view);
+}
+
+void DebugDrawer::render(std::vector<ColorPosition::VertexType> const &lines, glm::mat4 const &proj, glm::mat4 const &view)
+{
+    if (lines.empty())
+    {
+        return;
+    }
+
+    _buffer.stream(&lines[0], int(lines.size()));
 
     _shader.use();
     _shader.setupMatrices(proj, view, glm::mat4(1.0f));
@@ -54,9 +87,9 @@ void DebugDrawer::render(glm::mat4 const &proj, glm::mat4 const &view)
 
 void DebugDrawer::drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &color)
 {
-    _buffer.color(glm::vec4(color.x(), color.y(), color.z(), 1.0f));
-    _buffer.vertex(glm::vec3(from.x(), from.y(), from.z()));
-    _buffer.vertex(glm::vec3(to.x(), to.y(), to.z()));
+    auto c = glm::vec4(color.x(), color.y(), color.z(), 1.0f);
+    _target->push_back(ColorPosition::VertexType({glm::vec3(from.x(), from.y(), from.z()), c}));
+    _target->push_back(ColorPosition::VertexType({glm::vec3(to.x(), to.y(), to.z()), c}));
 }
 
 void DebugDrawer::drawContactPoint(const btVector3 &PointOnB, const btVector3 &normalOnB, btScalar distance, int lifeTime, const btVector3 &color)
@@ -73,13 +106,201 @@ void PhysicsManager::InitDebugDraw()
         _drawer = new DebugDrawer();
         _drawer->init();
     }
+    _drawer->setDebugMode(_debugOptions._modes);
     _dynamicsWorld->setDebugDrawer(_drawer);
 }
 
 void PhysicsManager::DebugDraw(glm::mat4 const &proj, glm::mat4 const &view)
 {
+    _drawer->collectInto(nullptr);
     _drawer->clearLines();
-    _dynamicsWorld->debugDrawWorld();
+    drawDebugWorld();
 
     _drawer->render(proj, view);
 }
+
+void PhysicsManager::CollectDebugLines(std::vector<ColorPosition::VertexType> &lines)
+{
+    if (_drawer == nullptr)
+    {
+        lines.clear();
+        return;
+    }
+
+    _drawer->collectInto(&lines);
+    _drawer->clearLines();
+    drawDebugWorld();
+    _drawer->collectInto(nullptr);
+}
+
+void PhysicsManager::DebugDraw(std::vector<ColorPosition::VertexType> const &lines, glm::mat4 const &proj, glm::mat4 const &view)
+{
+    if (_drawer == nullptr)
+    {
+        return;
+    }
+
+    _drawer->render(lines, proj, view);
+}
+
+PhysicsManager::DebugDrawOptions const &PhysicsManager::DebugOptions() const
+{
+    return _debugOptions;
+}
+
+void PhysicsManager::SetDebugOptions(DebugDrawOptions const &options)
+{
+    _debugOptions = options;
+
+    if (_drawer != nullptr)
+    {
+        _drawer->setDebugMode(options._modes);
+    }
+}
+
+void PhysicsManager::SetDebugCamera(glm::vec3 const &position, glm::mat4 const &projectionView)
+{
+    _hasDebugCamera = true;
+    _debugCameraPosition = position;
+    _debugCameraMatrix = projectionView;
+}
+
+static btScalar distanceToAabb(btVector3 const &point, btVector3 const &min, btVector3 const &max)
+{
+    btVector3 closest = point;
+    closest.setMax(min);
+    closest.setMin(max);
+
+    return point.distance(closest);
+}
+
+void PhysicsManager::drawDebugWorld()
+{
+    bool filtered = _hasDebugCamera &&
+                    (_debugOptions._cullToFrustum || _debugOptions._detailDistance > 0.0f || _debugOptions._maxDistance > 0.0f);
+
+    if (!filtered)
+    {
+        _dynamicsWorld->debugDrawWorld();
+        return;
+    }
+
+    // With culling only the objects the broadphase tree finds in view are visited
+    if (_debugOptions._cullToFrustum)
+    {
+        queryFrustum(_debugCameraMatrix, _queryObjects);
+    }
+    else
+    {
+        auto &objects = _dynamicsWorld->getCollisionObjectArray();
+
+        _queryObjects.clear();
+        for (int i = 0; i < objects.size(); i++)
+        {
+            _queryObjects.push_back(objects[i]);
+        }
+    }
+
+    auto camera = btVector3(_debugCameraPosition.x, _debugCameraPosition.y, _debugCameraPosition.z);
+    auto colors = _drawer->getDefaultColors();
+    auto modes = _debugOptions._modes;
+
+    for (auto obj : _queryObjects)
+    {
+        auto proxy = obj->getBroadphaseHandle();
+        if (proxy == nullptr)
+        {
+            continue;
+        }
+
+        auto distance = distanceToAabb(camera, proxy->m_aabbMin, proxy->m_aabbMax);
+        if (_debugOptions._maxDistance > 0.0f && distance > _debugOptions._maxDistance)
+        {
+            continue;
+        }
+
+        btVector3 color;
+        switch (obj->getActivationState())
+        {
+            case ACTIVE_TAG:
+                color = colors.m_activeObject;
+                break;
+            case ISLAND_SLEEPING:
+                color = colors.m_deactivatedObject;
+                break;
+            case WANTS_DEACTIVATION:
+                color = colors.m_wantsDeactivationObject;
+                break;
+            case DISABLE_DEACTIVATION:
+                color = colors.m_disabledDeactivationObject;
+                break;
+            default:
+                color = colors.m_disabledSimulationObject;
+                break;
+        }
+
+        // Far away objects are just their box, that is 12 lines no matter the shape
+        if (_debugOptions._detailDistance > 0.0f && distance > _debugOptions._detailDistance)
+        {
+            _drawer->drawAabb(proxy->m_aabbMin, proxy->m_aabbMax, color);
+            continue;
+        }
+
+        if (modes & btIDebugDraw::DBG_DrawWireframe)
+        {
+            _dynamicsWorld->debugDrawObject(obj->getWorldTransform(), obj->getCollisionShape(), color);
+        }
+        if (modes & btIDebugDraw::DBG_DrawAabb)
+        {
+            _drawer->drawAabb(proxy->m_aabbMin, proxy->m_aabbMax, colors.m_aabb);
+        }
+    }
+
+    if (modes & (btIDebugDraw::DBG_DrawConstraints | btIDebugDraw::DBG_DrawConstraintLimits))
+    {
+        for (int i = 0; i < _dynamicsWorld->getNumConstraints(); i++)
+        {
+            _dynamicsWorld->debugDrawConstraint(_dynamicsWorld->getConstraint(i));
+        }
+    }
+
+    // Same condition as the action loop in debugDrawWorld(). The car vehicles
+    // are the only actions this manager adds to the world.
+    if (modes & (btIDebugDraw::DBG_DrawWireframe | btIDebugDraw::DBG_DrawAabb | btIDebugDraw::DBG_DrawNormals))
+    {
+        _store->_cars.ForEach([&](int, CarPhysicsObject &car) {
+            auto vehicle = car.GetVehicle();
+            if (vehicle == nullptr)
+            {
+                return;
+            }
+
+            auto proxy = vehicle->getRigidBody()->getBroadphaseHandle();
+            if (_debugOptions._maxDistance > 0.0f && proxy != nullptr && distanceToAabb(camera, proxy->m_aabbMin, proxy->m_aabbMax) > _debugOptions._maxDistance)
+            {
+                return;
+            }
+
+            vehicle->debugDraw(_drawer);
+        });
+    }
+
+    if (modes & btIDebugDraw::DBG_DrawContactPoints)
+    {
+        auto dispatcher = _dynamicsWorld->getDispatcher();
+        for (int i = 0; i < dispatcher->getNumManifolds(); i++)
+        {
+            auto manifold = dispatcher->getManifoldByIndexInternal(i);
+            for (int j = 0; j < manifold->getNumContacts(); j++)
+            {
+                auto const &point = manifold->getContactPoint(j);
+                if (_debugOptions._maxDistance > 0.0f && camera.distance(point.getPositionWorldOnB()) > _debugOptions._maxDistance)
+                {
+                    continue;
+                }
+
+                _drawer->drawContactPoint(point.getPositionWorldOnB(), point.m_normalWorldOnB, point.getDistance(), point.getLifeTime(), colors.m_contactPoint);
+            }
+        }
+    }
+}
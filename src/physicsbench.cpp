@@ -0,0 +1,272 @@
+#include "physics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Builds scenes of N objects with PhysicsObjectBuilder, steps them for a fixed
+// number of ticks and reports step time percentiles next to the broadphase
+// pair and contact manifold counts.
+//
+// usage: physics-bench [--shape box|sphere|capsule|car|mixed] [--ticks N] [--counts 10,100,...]
+//                      [--workers 0,1,2,...] [--bulk]
+//
+// With --bulk the scene is spawned through PhysicsManager::BuildObjects(),
+// cars are still built one by one. Every scene runs once per worker count,
+// 0 is the single threaded world and anything above needs BT_THREADSAFE.
+
+enum class BenchShape
+{
+    Box,
+    Sphere,
+    Capsule,
+    Car,
+    Mixed,
+};
+
+struct BenchResult
+{
+    int count;
+    int workers;
+    double setupMs;
+    double p50Ms;
+    double p90Ms;
+    double p99Ms;
+    double maxMs;
+    double avgPairs;
+    double avgManifolds;
+};
+
+static void spawnObject(PhysicsManager &physics, std::vector<PhysicsObjectBuilder> *bulk, BenchShape shape, int index, glm::vec3 const &pos)
+{
+    if (shape == BenchShape::Mixed)
+    {
+        shape = BenchShape(index % int(BenchShape::Mixed));
+    }
+
+    PhysicsObjectBuilder builder(physics);
+    builder.InitialPosition(pos).Mass(1.0f);
+
+    switch (shape)
+    {
+        case BenchShape::Box:
+            builder.Box(glm::vec3(1.0f));
+            break;
+        case BenchShape::Sphere:
+            builder.Sphere(0.5f);
+            break;
+        case BenchShape::Capsule:
+            builder.Capsule(0.5f, 1.0f, glm::vec3(0.0f));
+            break;
+        case BenchShape::Car:
+            builder.Car(glm::vec3(1.0f, 0.5f, 2.0f)).Mass(100.0f).BuildCar();
+            return;
+        default:
+            return;
+    }
+
+    if (bulk != nullptr)
+    {
+        bulk->push_back(builder);
+    }
+    else
+    {
+        builder.Build();
+    }
+}
+
+static double percentile(std::vector<double> const &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+
+    auto index = size_t(p * (sorted.size() - 1) + 0.5);
+
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static BenchResult runScene(BenchShape shape, int count, int workers, int ticks, bool bulk)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    BenchResult result = {count, 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+    PhysicsManager physics(workers);
+    result.workers = physics.WorkerCount();
+
+    // Objects are dropped in a few layers on a grid, so they pile up and the
+    // solver has real contacts to work through
+    const float spacing = 3.0f;
+    int layers = count < 100 ? 1 : 4;
+    int side = int(std::ceil(std::sqrt(float(count) / float(layers))));
+    float extent = side * spacing;
+
+    auto setupStart = Clock::now();
+
+    PhysicsObjectBuilder(physics)
+        .Box(glm::vec3(extent + 10.0f, extent + 10.0f, 0.1f))
+        .Mass(0.0f)
+        .Build();
+
+    std::vector<PhysicsObjectBuilder> builders;
+    if (bulk)
+    {
+        builders.reserve(count);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int layer = i / (side * side);
+        int x = (i % (side * side)) % side;
+        int y = (i % (side * side)) / side;
+
+        auto pos = glm::vec3(
+            x * spacing - extent / 2.0f,
+            y * spacing - extent / 2.0f,
+            2.0f + layer * spacing);
+
+        spawnObject(physics, bulk ? &builders : nullptr, shape, i, pos);
+    }
+
+    if (bulk)
+    {
+        physics.BuildObjects(builders);
+    }
+
+    result.setupMs = std::chrono::duration<double, std::milli>(Clock::now() - setupStart).count();
+
+    std::vector<double> stepTimes;
+    stepTimes.reserve(ticks);
+
+    double pairs = 0.0;
+    double manifolds = 0.0;
+
+    for (int tick = 0; tick < ticks; tick++)
+    {
+        auto start = Clock::now();
+        physics.Step(physics.FixedTimeStep());
+        stepTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+        pairs += physics.OverlappingPairCount();
+        manifolds += physics.ContactManifoldCount();
+    }
+
+    std::sort(stepTimes.begin(), stepTimes.end());
+
+    result.p50Ms = percentile(stepTimes, 0.5);
+    result.p90Ms = percentile(stepTimes, 0.9);
+    result.p99Ms = percentile(stepTimes, 0.99);
+    result.maxMs = stepTimes.empty() ? 0.0 : stepTimes.back();
+    result.avgPairs = ticks > 0 ? pairs / ticks : 0.0;
+    result.avgManifolds = ticks > 0 ? manifolds / ticks : 0.0;
+
+    return result;
+}
+
+static std::vector<int> parseList(char const *list)
+{
+    std::vector<int> result;
+
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        result.push_back(atoi(item.c_str()));
+    }
+
+    return result;
+}
+
+static bool parseShape(std::string const &name, BenchShape &shape)
+{
+    static const char *names[] = {"box", "sphere", "capsule", "car", "mixed"};
+
+    for (int i = 0; i <= int(BenchShape::Mixed); i++)
+    {
+        if (name == names[i])
+        {
+            shape = BenchShape(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchShape shape = BenchShape::Box;
+    int ticks = 300;
+    std::vector<int> counts = {10, 100, 1000, 10000, 100000};
+    std::vector<int> workers = {0};
+    bool bulk = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc)
+        {
+            if (!parseShape(argv[++i], shape))
+            {
+                std::cerr << "unknown shape \"" << argv[i] << "\"" << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bulk") == 0)
+        {
+            bulk = true;
+        }
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+        {
+            ticks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--counts") == 0 && i + 1 < argc)
+        {
+            counts = parseList(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            workers = parseList(argv[++i]);
+        }
+    }
+
+    std::cout << std::setw(8) << "objects"
+              << std::setw(9) << "workers"
+              << std::setw(12) << "setup ms"
+              << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms"
+              << std::setw(10) << "max ms"
+              << std::setw(12) << "pairs"
+              << std::setw(12) << "manifolds" << std::endl;
+
+    for (auto count : counts)
+    {
+        for (auto workerCount : workers)
+        {
+            auto result = runScene(shape, count, workerCount, ticks, bulk);
+
+            std::cout << std::fixed << std::setprecision(3)
+                      << std::setw(8) << result.count
+                      << std::setw(9) << result.workers
+                      << std::setw(12) << result.setupMs
+                      << std::setw(10) << result.p50Ms
+                      << std::setw(10) << result.p90Ms
+                      << std::setw(10) << result.p99Ms
+                      << std::setw(10) << result.maxMs
+                      << std::setprecision(0)
+                      << std::setw(12) << result.avgPairs
+                      << std::setw(12) << result.avgManifolds << std::endl;
+        }
+    }
+
+    return 0;
+}
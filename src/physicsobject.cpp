@@ -1,4 +1,4 @@
-#include "physicsobject.h"
+#include "physicsobjectimpl.h"
 #include "physics.h"
 
 #include <btBulletCollisionCommon.h>
@@ -10,18 +10,19 @@
 #include <glm/gtx/quaternion.hpp>
 #include <numeric>
 
-class ImplPhysicsObject : public btMotionState, public PhysicsObject
-{
-public:
-    glm::mat4 _matrix;
-    btRigidBody *_rigidBody;
 
-    void getWorldTransform(btTransform &worldTrans) const;
-    void setWorldTransform(const btTransform &worldTrans);
+ImplPhysicsObject::ImplPhysicsObject()
+    : _matrix(1.0f), _previousMatrix(1.0f), _rigidBody(nullptr), _manager(nullptr), _updateStep(0), _bodyIndex(-1)
+{
+    _handle._pool = 0;
+    _handle._generation = 0;
+    _handle._index = -1;
+}
 
-    virtual glm::mat4 const &getMatrix() const;
-    virtual class btRigidBody *getRigidBody();
-};
+PhysicsObjectHandle ImplPhysicsObject::getHandle() const
+{
+    return _handle;
+}
 
 void ImplPhysicsObject::getWorldTransform(btTransform &worldTrans) const
 {
@@ -30,7 +31,13 @@ void ImplPhysicsObject::getWorldTransform(btTransform &worldTrans) const
 
 void ImplPhysicsObject::setWorldTransform(const btTransform &worldTrans)
 {
+    _previousMatrix = _matrix;
     worldTrans.getOpenGLMatrix(glm::value_ptr(_matrix));
+
+    if (_manager != nullptr)
+    {
+        _updateStep = _manager->StepCount();
+    }
 }
 
 glm::mat4 const &ImplPhysicsObject::getMatrix() const
@@ -38,28 +45,31 @@ glm::mat4 const &ImplPhysicsObject::getMatrix() const
     return _matrix;
 }
 
-btRigidBody *ImplPhysicsObject::getRigidBody()
+glm::mat4 const &ImplPhysicsObject::getPreviousMatrix() const
 {
-    return _rigidBody;
+    return _previousMatrix;
 }
 
-class CharacterPhysicsObject : public CharacterObject, public ImplPhysicsObject
+glm::mat4 ImplPhysicsObject::getInterpolatedMatrix(float alpha) const
 {
-    float _forward;
-    float _left;
+    // Bullet only calls setWorldTransform for active bodies, so when we were
+    // not updated in the last step the previous matrix is stale
+    if (_manager == nullptr || _updateStep != _manager->StepCount())
+    {
+        return _matrix;
+    }
 
-public:
-    CharacterPhysicsObject();
+    auto result = glm::mat4_cast(glm::slerp(glm::quat_cast(_previousMatrix), glm::quat_cast(_matrix), alpha));
+    result[3] = glm::mix(_previousMatrix[3], _matrix[3], alpha);
 
-    virtual void Update();
-    virtual void Forward(float amount);
-    virtual void Left(float amount);
-    virtual void Jump();
-    virtual bool IsJumping();
+    return result;
+}
+
+btRigidBody *ImplPhysicsObject::getRigidBody()
+{
+    return _rigidBody;
+}
 
-    virtual glm::mat4 const &getMatrix() const;
-    virtual class btRigidBody *getRigidBody();
-};
 
 CharacterPhysicsObject::CharacterPhysicsObject()
     : _forward(0.0f), _left(0.0f)
@@ -129,56 +139,35 @@ bool CharacterPhysicsObject::IsJumping()
     return glm::abs(velocity.z()) > 0.01f;
 }
 
+PhysicsObjectHandle CharacterPhysicsObject::getHandle() const
+{
+    return ImplPhysicsObject::getHandle();
+}
+
 glm::mat4 const &CharacterPhysicsObject::getMatrix() const
 {
     return ImplPhysicsObject::getMatrix();
 }
 
-btRigidBody *CharacterPhysicsObject::getRigidBody()
+glm::mat4 const &CharacterPhysicsObject::getPreviousMatrix() const
 {
-    return ImplPhysicsObject::getRigidBody();
+    return ImplPhysicsObject::getPreviousMatrix();
 }
 
-class CarPhysicsObject : public CarObject, public ImplPhysicsObject
+glm::mat4 CharacterPhysicsObject::getInterpolatedMatrix(float alpha) const
 {
-    const float MIN_SPEED = -50.0f;
-    const float MAX_SPEED = 100.0f;
-    const float MIN_STEER = -0.3f;
-    const float MAX_STEER = 0.3f;
-
-    bool _engineStarted;
-    float _speed;
-    float _steering;
-    bool _brakeNextUpdate;
-    glm::mat4 _wheelMatrix[4];
-    btRaycastVehicle *_vehicle;
-    btDefaultVehicleRaycaster *_vehicleRayCaster;
-
-public:
-    CarPhysicsObject();
-
-    void SetVehicle(btRaycastVehicle *vehicle, btDefaultVehicleRaycaster *vehicleRayCaster);
-
-    virtual void Update();
-    virtual void StartEngine();
-    virtual void ChangeSpeed(float amount);
-    virtual void Steer(float amount);
-    virtual void Brake();
-    virtual void StopEngine();
-
-    virtual float Speed() const;
-    virtual float Steering() const;
-
-    void setWorldTransform(const btTransform &worldTrans);
+    return ImplPhysicsObject::getInterpolatedMatrix(alpha);
+}
 
-    virtual glm::mat4 const &getMatrix() const;
-    virtual class btRigidBody *getRigidBody();
+btRigidBody *CharacterPhysicsObject::getRigidBody()
+{
+    return ImplPhysicsObject::getRigidBody();
+}
 
-    virtual glm::mat4 const &getWheelMatrix(int wheel) const;
-};
 
 CarPhysicsObject::CarPhysicsObject()
-    : _engineStarted(false), _speed(0.0f), _steering(0.0f), _brakeNextUpdate(false)
+    : _engineStarted(false), _speed(0.0f), _steering(0.0f), _brakeNextUpdate(false),
+      _vehicle(nullptr), _vehicleRayCaster(nullptr)
 {
     _wheelMatrix[0] = glm::mat4(1.0f);
     _wheelMatrix[1] = glm::mat4(1.0f);
@@ -204,6 +193,27 @@ void CarPhysicsObject::SetVehicle(btRaycastVehicle *vehicle, btDefaultVehicleRay
     _vehicleRayCaster = vehicleRayCaster;
 }
 
+btRaycastVehicle *CarPhysicsObject::GetVehicle() const
+{
+    return _vehicle;
+}
+
+void CarPhysicsObject::RemoveVehicle(btDynamicsWorld *world)
+{
+    if (_vehicle != nullptr)
+    {
+        world->removeVehicle(_vehicle);
+        delete _vehicle;
+        _vehicle = nullptr;
+    }
+
+    if (_vehicleRayCaster != nullptr)
+    {
+        delete _vehicleRayCaster;
+        _vehicleRayCaster = nullptr;
+    }
+}
+
 void CarPhysicsObject::Update()
 {
     if (!_engineStarted)
@@ -312,16 +322,131 @@ glm::mat4 const &CarPhysicsObject::getWheelMatrix(int wheel) const
     return _wheelMatrix[wheel];
 }
 
+PhysicsObjectHandle CarPhysicsObject::getHandle() const
+{
+    return ImplPhysicsObject::getHandle();
+}
+
 glm::mat4 const &CarPhysicsObject::getMatrix() const
 {
     return ImplPhysicsObject::getMatrix();
 }
 
+glm::mat4 const &CarPhysicsObject::getPreviousMatrix() const
+{
+    return ImplPhysicsObject::getPreviousMatrix();
+}
+
+glm::mat4 CarPhysicsObject::getInterpolatedMatrix(float alpha) const
+{
+    return ImplPhysicsObject::getInterpolatedMatrix(alpha);
+}
+
 btRigidBody *CarPhysicsObject::getRigidBody()
 {
     return ImplPhysicsObject::getRigidBody();
 }
 
+ImplPhysicsObject *PhysicsObjectStore::CreateObject()
+{
+    int index = _objects.Create();
+    auto obj = _objects.Get(index);
+
+    obj->_handle._pool = ObjectPoolId;
+    obj->_handle._generation = _objects.Generation(index);
+    obj->_handle._index = index;
+
+    return obj;
+}
+
+CharacterPhysicsObject *PhysicsObjectStore::CreateCharacter()
+{
+    int index = _characters.Create();
+    auto obj = _characters.Get(index);
+
+    obj->_handle._pool = CharacterPoolId;
+    obj->_handle._generation = _characters.Generation(index);
+    obj->_handle._index = index;
+
+    return obj;
+}
+
+CarPhysicsObject *PhysicsObjectStore::CreateCar()
+{
+    int index = _cars.Create();
+    auto obj = _cars.Get(index);
+
+    obj->_handle._pool = CarPoolId;
+    obj->_handle._generation = _cars.Generation(index);
+    obj->_handle._index = index;
+
+    return obj;
+}
+
+btRigidBody *PhysicsObjectStore::CreateBody(ImplPhysicsObject *obj, btRigidBody::btRigidBodyConstructionInfo const &info)
+{
+    obj->_bodyIndex = _bodies.Create(info);
+    obj->_rigidBody = _bodies.Get(obj->_bodyIndex);
+    obj->_rigidBody->setUserPointer(obj);
+
+    return obj->_rigidBody;
+}
+
+ImplPhysicsObject *PhysicsObjectStore::Find(PhysicsObjectHandle const &handle)
+{
+    ImplPhysicsObject *obj = nullptr;
+
+    switch (handle._pool)
+    {
+        case ObjectPoolId:
+            obj = _objects.Get(handle._index);
+            break;
+        case CharacterPoolId:
+            obj = _characters.Get(handle._index);
+            break;
+        case CarPoolId:
+            obj = _cars.Get(handle._index);
+            break;
+    }
+
+    if (obj == nullptr || !(obj->_handle == handle))
+    {
+        return nullptr;
+    }
+
+    return obj;
+}
+
+void PhysicsObjectStore::Destroy(ImplPhysicsObject *obj)
+{
+    if (obj == nullptr)
+    {
+        return;
+    }
+
+    auto handle = obj->_handle;
+
+    _bodies.Destroy(obj->_bodyIndex);
+
+    switch (handle._pool)
+    {
+        case ObjectPoolId:
+            _objects.Destroy(handle._index);
+            break;
+        case CharacterPoolId:
+            _characters.Destroy(handle._index);
+            break;
+        case CarPoolId:
+            _cars.Destroy(handle._index);
+            break;
+    }
+}
+
+int PhysicsObjectStore::Count() const
+{
+    return _objects.Count() + _characters.Count() + _cars.Count();
+}
+
 PhysicsObjectBuilder::PhysicsObjectBuilder(PhysicsManager &manager)
     : _manager(manager)
 {
@@ -334,7 +459,7 @@ PhysicsObjectBuilder::PhysicsObjectBuilder(PhysicsManager &manager)
     _angularDamping = 0.9f;
 }
 
-PhysicsObject *PhysicsObjectBuilder::Build()
+ImplPhysicsObject *PhysicsObjectBuilder::createObject() const
 {
     if (_shape == nullptr)
     {
@@ -347,15 +472,25 @@ PhysicsObject *PhysicsObjectBuilder::Build()
         _shape->calculateLocalInertia(_mass, localInertia);
     }
 
-    auto obj = new ImplPhysicsObject();
+    auto obj = _manager._store->CreateObject();
     obj->_matrix = glm::toMat4(_initialRot) * glm::translate(glm::mat4(1.0f), _initialPos);
+    obj->_previousMatrix = obj->_matrix;
+    obj->_manager = &_manager;
 
     auto rbInfo = btRigidBody::btRigidBodyConstructionInfo(_mass, obj, _shape, localInertia);
-    obj->_rigidBody = new btRigidBody(rbInfo);
+    _manager._store->CreateBody(obj, rbInfo);
+    _manager._shapes.AddRef(_shape);
 
     obj->_rigidBody->setFriction(_friction);
     obj->_rigidBody->setDamping(_linearDamping, _angularDamping);
 
+    return obj;
+}
+
+PhysicsObject *PhysicsObjectBuilder::Build()
+{
+    auto obj = createObject();
+
     _manager.AddObject(obj);
 
     return obj;
@@ -421,11 +556,14 @@ CarObject *PhysicsObjectBuilder::BuildCar()
         _shape->calculateLocalInertia(_mass, localInertia);
     }
 
-    auto obj = new CarPhysicsObject();
+    auto obj = _manager._store->CreateCar();
     obj->_matrix = glm::translate(glm::mat4(1.0f), _initialPos);
+    obj->_previousMatrix = obj->_matrix;
+    obj->_manager = &_manager;
 
     auto rbInfo = btRigidBody::btRigidBodyConstructionInfo(_mass, obj, _shape, localInertia);
-    obj->_rigidBody = new btRigidBody(rbInfo);
+    _manager._store->CreateBody(obj, rbInfo);
+    _manager._shapes.AddRef(_shape);
     obj->_rigidBody->setActivationState(DISABLE_DEACTIVATION);
 
     float wheelRadius = 0.5f;
@@ -455,17 +593,25 @@ CarObject *PhysicsObjectBuilder::BuildCar()
 
 CharacterObject *PhysicsObjectBuilder::BuildCharacter()
 {
+    if (_shape == nullptr)
+    {
+        return nullptr;
+    }
+
     btVector3 localInertia(0, 0, 0);
     if (_mass != 0.0f)
     {
         _shape->calculateLocalInertia(_mass, localInertia);
     }
 
-    auto obj = new CharacterPhysicsObject();
+    auto obj = _manager._store->CreateCharacter();
     obj->_matrix = glm::toMat4(_initialRot) * glm::translate(glm::mat4(1.0f), _initialPos);
+    obj->_previousMatrix = obj->_matrix;
+    obj->_manager = &_manager;
 
     auto rbInfo = btRigidBody::btRigidBodyConstructionInfo(_mass, obj, _shape, localInertia);
-    obj->_rigidBody = new btRigidBody(rbInfo);
+    _manager._store->CreateBody(obj, rbInfo);
+    _manager._shapes.AddRef(_shape);
     obj->_rigidBody->setActivationState(DISABLE_DEACTIVATION);
 
     obj->_rigidBody->setFriction(_friction);
@@ -480,25 +626,21 @@ CharacterObject *PhysicsObjectBuilder::BuildCharacter()
 PhysicsObjectBuilder &PhysicsObjectBuilder::Box(glm::vec3 const &size)
 {
     _inputSize = size;
-    this->_shape = new btBoxShape(btVector3(size.x / 2.0f, size.y / 2.0f, size.z / 2.0f));
+    this->_shape = _manager._shapes.Box(size);
 
     return (*this);
 }
 
 PhysicsObjectBuilder &PhysicsObjectBuilder::Sphere(float radius)
 {
-    this->_shape = new btSphereShape(radius);
+    this->_shape = _manager._shapes.Sphere(radius);
 
     return (*this);
 }
 
 PhysicsObjectBuilder &PhysicsObjectBuilder::Capsule(float radius, float height, glm::vec3 const &centerOfMass)
 {
-    btVector3 p[3] = {
-        btVector3(centerOfMass.x, centerOfMass.y - (height / 2.0f), centerOfMass.z),
-        btVector3(centerOfMass.x, centerOfMass.y + (height / 2.0f), centerOfMass.z)};
-    float r[3] = {radius, radius};
-    this->_shape = new btMultiSphereShape(p, r, 2);
+    this->_shape = _manager._shapes.Capsule(radius, height, centerOfMass);
 
     return (*this);
 }
@@ -506,35 +648,22 @@ PhysicsObjectBuilder &PhysicsObjectBuilder::Capsule(float radius, float height,
 PhysicsObjectBuilder &PhysicsObjectBuilder::Cylinder(glm::vec3 const &size)
 {
     _inputSize = size;
-    this->_shape = new btCylinderShape(btVector3(size.x / 2.0f, size.y / 2.0f, size.z / 2.0f));
+    this->_shape = _manager._shapes.Cylinder(size);
 
     return (*this);
 }
 
 PhysicsObjectBuilder &PhysicsObjectBuilder::Cone(float radius, float height)
 {
-    this->_shape = new btConeShape(radius, height);
+    this->_shape = _manager._shapes.Cone(radius, height);
 
     return (*this);
 }
 
 PhysicsObjectBuilder &PhysicsObjectBuilder::Car(glm::vec3 const &size)
 {
-    btTransform localTrans;
-    localTrans.setIdentity();
-    localTrans.setOrigin(btVector3(0, size.y + 0.5f, 0));
-
-    btCollisionShape *chassis = new btBoxShape(btVector3(size.x, size.y, size.z));
-    btCompoundShape *shape = new btCompoundShape();
-    shape->addChildShape(localTrans, chassis);
-
-    btCollisionShape *shover = new btBoxShape(btVector3(size.x * 1.5f, size.y, 1.0f));
-    localTrans.setIdentity();
-    localTrans.setOrigin(btVector3(0.0f, size.y + 0.5f, size.z + 1.0f));
-    localTrans.setRotation(btQuaternion(_initialRot.x, _initialRot.y, _initialRot.z, _initialRot.w));
-    shape->addChildShape(localTrans, shover);
-
-    this->_shape = shape;
+    _inputSize = size;
+    this->_shape = _manager._shapes.Car(size, _initialRot);
 
     return (*this);
 }
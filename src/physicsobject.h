@@ -4,12 +4,37 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+// Stays valid for the lifetime of the object, PhysicsManager::FindObject()
+// returns nullptr for a handle of an object that was destroyed
+class PhysicsObjectHandle
+{
+public:
+    unsigned short _pool;
+    unsigned int _generation; // 32 bits, a slot is not reused that often
+    int _index;
+
+    bool operator==(PhysicsObjectHandle const &other) const
+    {
+        return _pool == other._pool && _generation == other._generation && _index == other._index;
+    }
+
+    bool operator<(PhysicsObjectHandle const &other) const
+    {
+        if (_pool != other._pool) return _pool < other._pool;
+        if (_index != other._index) return _index < other._index;
+        return _generation < other._generation;
+    }
+};
+
 class PhysicsObject
 {
 public:
     virtual ~PhysicsObject() {}
 
+    virtual PhysicsObjectHandle getHandle() const = 0;
     virtual glm::mat4 const &getMatrix() const = 0;
+    virtual glm::mat4 const &getPreviousMatrix() const = 0;
+    virtual glm::mat4 getInterpolatedMatrix(float alpha) const = 0;
     virtual class btRigidBody *getRigidBody() = 0;
 };
 
@@ -41,6 +66,8 @@ public:
 
 class PhysicsObjectBuilder
 {
+    friend class PhysicsManager;
+
     class PhysicsManager &_manager;
     class btCollisionShape *_shape;
     glm::vec3 _initialPos;
@@ -51,6 +78,8 @@ class PhysicsObjectBuilder
     float _angularDamping;
     glm::vec3 _inputSize;
 
+    class ImplPhysicsObject *createObject() const;
+
 public:
     PhysicsObjectBuilder(class PhysicsManager &manager);
     PhysicsObjectBuilder &Box(glm::vec3 const &size);
@@ -0,0 +1,128 @@
+#ifndef PHYSICSOBJECTIMPL_H
+#define PHYSICSOBJECTIMPL_H
+
+#include "objectpool.h"
+#include "physicsobject.h"
+
+#include <btBulletDynamicsCommon.h>
+
+class PhysicsManager;
+
+class ImplPhysicsObject : public btMotionState, public PhysicsObject
+{
+public:
+    ImplPhysicsObject();
+
+    glm::mat4 _matrix;
+    glm::mat4 _previousMatrix;
+    btRigidBody *_rigidBody;
+    PhysicsManager *_manager;
+    unsigned int _updateStep;
+    PhysicsObjectHandle _handle;
+    int _bodyIndex;
+
+    void getWorldTransform(btTransform &worldTrans) const;
+    void setWorldTransform(const btTransform &worldTrans);
+
+    virtual PhysicsObjectHandle getHandle() const;
+    virtual glm::mat4 const &getMatrix() const;
+    virtual glm::mat4 const &getPreviousMatrix() const;
+    virtual glm::mat4 getInterpolatedMatrix(float alpha) const;
+    virtual class btRigidBody *getRigidBody();
+};
+
+class CharacterPhysicsObject : public CharacterObject, public ImplPhysicsObject
+{
+    float _forward;
+    float _left;
+
+public:
+    CharacterPhysicsObject();
+
+    virtual void Update();
+    virtual void Forward(float amount);
+    virtual void Left(float amount);
+    virtual void Jump();
+    virtual bool IsJumping();
+
+    virtual PhysicsObjectHandle getHandle() const;
+    virtual glm::mat4 const &getMatrix() const;
+    virtual glm::mat4 const &getPreviousMatrix() const;
+    virtual glm::mat4 getInterpolatedMatrix(float alpha) const;
+    virtual class btRigidBody *getRigidBody();
+};
+
+class CarPhysicsObject : public CarObject, public ImplPhysicsObject
+{
+    const float MIN_SPEED = -50.0f;
+    const float MAX_SPEED = 100.0f;
+    const float MIN_STEER = -0.3f;
+    const float MAX_STEER = 0.3f;
+
+    bool _engineStarted;
+    float _speed;
+    float _steering;
+    bool _brakeNextUpdate;
+    glm::mat4 _wheelMatrix[4];
+    btRaycastVehicle *_vehicle;
+    btDefaultVehicleRaycaster *_vehicleRayCaster;
+
+public:
+    CarPhysicsObject();
+
+    void SetVehicle(btRaycastVehicle *vehicle, btDefaultVehicleRaycaster *vehicleRayCaster);
+    void RemoveVehicle(btDynamicsWorld *world);
+    btRaycastVehicle *GetVehicle() const;
+
+    virtual void Update();
+    virtual void StartEngine();
+    virtual void ChangeSpeed(float amount);
+    virtual void Steer(float amount);
+    virtual void Brake();
+    virtual void StopEngine();
+
+    virtual float Speed() const;
+    virtual float Steering() const;
+
+    void setWorldTransform(const btTransform &worldTrans);
+
+    virtual PhysicsObjectHandle getHandle() const;
+    virtual glm::mat4 const &getMatrix() const;
+    virtual glm::mat4 const &getPreviousMatrix() const;
+    virtual glm::mat4 getInterpolatedMatrix(float alpha) const;
+    virtual class btRigidBody *getRigidBody();
+
+    virtual glm::mat4 const &getWheelMatrix(int wheel) const;
+};
+
+// Pools for every kind of physics object and their rigid bodies, owned by
+// PhysicsManager. The pool index of a handle tells which pool it points into.
+class PhysicsObjectStore
+{
+public:
+    enum PoolIds
+    {
+        ObjectPoolId,
+        CharacterPoolId,
+        CarPoolId,
+    };
+
+    ObjectPool<ImplPhysicsObject> _objects;
+    ObjectPool<CharacterPhysicsObject> _characters;
+    ObjectPool<CarPhysicsObject> _cars;
+    ObjectPool<btRigidBody> _bodies;
+
+    ImplPhysicsObject *CreateObject();
+    CharacterPhysicsObject *CreateCharacter();
+    CarPhysicsObject *CreateCar();
+    btRigidBody *CreateBody(ImplPhysicsObject *obj, btRigidBody::btRigidBodyConstructionInfo const &info);
+
+    ImplPhysicsObject *Find(PhysicsObjectHandle const &handle);
+
+    // Only frees the memory, the body has to be out of the world already
+    void Destroy(ImplPhysicsObject *obj);
+
+    int Count() const;
+};
+
+#endif // PHYSICSOBJECTIMPL_H
@@ -0,0 +1,225 @@
+#include "shapecache.h"
+
+#include <algorithm>
+#include <btBulletCollisionCommon.h>
+
+bool CollisionShapeCache::Key::operator<(Key const &other) const
+{
+    if (_type != other._type)
+    {
+        return _type < other._type;
+    }
+
+    return std::lexicographical_compare(_params, _params + 7, other._params, other._params + 7);
+}
+
+CollisionShapeCache::CollisionShapeCache()
+{
+}
+
+CollisionShapeCache::~CollisionShapeCache()
+{
+    for (auto &pair : _shapes)
+    {
+        deleteShape(pair.second._shape);
+    }
+    _shapes.clear();
+    _lookup.clear();
+}
+
+CollisionShapeCache::Key CollisionShapeCache::makeKey(ShapeType type, float p0, float p1, float p2, float p3, float p4, float p5, float p6) const
+{
+    Key key = {type, {p0, p1, p2, p3, p4, p5, p6}};
+
+    return key;
+}
+
+btCollisionShape *CollisionShapeCache::find(Key const &key) const
+{
+    auto found = _shapes.find(key);
+    if (found == _shapes.end())
+    {
+        return nullptr;
+    }
+
+    return found->second._shape;
+}
+
+btCollisionShape *CollisionShapeCache::insert(Key const &key, btCollisionShape *shape)
+{
+    Entry entry = {shape, 0};
+
+    auto inserted = _shapes.insert(std::make_pair(key, entry)).first;
+    _lookup.insert(std::make_pair(shape, inserted));
+
+    return shape;
+}
+
+void CollisionShapeCache::deleteShape(btCollisionShape *shape)
+{
+    if (shape == nullptr)
+    {
+        return;
+    }
+
+    // Compound shapes from Car() own their children
+    if (shape->isCompound())
+    {
+        auto compound = static_cast<btCompoundShape *>(shape);
+        for (int i = 0; i < compound->getNumChildShapes(); i++)
+        {
+            delete compound->getChildShape(i);
+        }
+    }
+
+    delete shape;
+}
+
+btCollisionShape *CollisionShapeCache::Box(glm::vec3 const &size)
+{
+    auto key = makeKey(ShapeType::Box, size.x, size.y, size.z);
+
+    auto shape = find(key);
+    if (shape != nullptr)
+    {
+        return shape;
+    }
+
+    return insert(key, new btBoxShape(btVector3(size.x / 2.0f, size.y / 2.0f, size.z / 2.0f)));
+}
+
+btCollisionShape *CollisionShapeCache::Sphere(float radius)
+{
+    auto key = makeKey(ShapeType::Sphere, radius);
+
+    auto shape = find(key);
+    if (shape != nullptr)
+    {
+        return shape;
+    }
+
+    return insert(key, new btSphereShape(radius));
+}
+
+btCollisionShape *CollisionShapeCache::Capsule(float radius, float height, glm::vec3 const &centerOfMass)
+{
+    auto key = makeKey(ShapeType::Capsule, radius, height, centerOfMass.x, centerOfMass.y, centerOfMass.z);
+
+    auto shape = find(key);
+    if (shape != nullptr)
+    {
+        return shape;
+    }
+
+    btVector3 p[3] = {
+        btVector3(centerOfMass.x, centerOfMass.y - (height / 2.0f), centerOfMass.z),
+        btVector3(centerOfMass.x, centerOfMass.y + (height / 2.0f), centerOfMass.z)};
+    float r[3] = {radius, radius};
+
+    return insert(key, new btMultiSphereShape(p, r, 2));
+}
+
+btCollisionShape *CollisionShapeCache::Cylinder(glm::vec3 const &size)
+{
+    auto key = makeKey(ShapeType::Cylinder, size.x, size.y, size.z);
+
+    auto shape = find(key);
+    if (shape != nullptr)
+    {
+        return shape;
+    }
+
+    return insert(key, new btCylinderShape(btVector3(size.x / 2.0f, size.y / 2.0f, size.z / 2.0f)));
+}
+
+btCollisionShape *CollisionShapeCache::Cone(float radius, float height)
+{
+    auto key = makeKey(ShapeType::Cone, radius, height);
+
+    auto shape = find(key);
+    if (shape != nullptr)
+    {
+        return shape;
+    }
+
+    return insert(key, new btConeShape(radius, height));
+}
+
+btCollisionShape *CollisionShapeCache::Car(glm::vec3 const &size, glm::quat const &rotation)
+{
+    auto key = makeKey(ShapeType::Car, size.x, size.y, size.z, rotation.x, rotation.y, rotation.z, rotation.w);
+
+    auto found = find(key);
+    if (found != nullptr)
+    {
+        return found;
+    }
+
+    btTransform localTrans;
+    localTrans.setIdentity();
+    localTrans.setOrigin(btVector3(0, size.y + 0.5f, 0));
+
+    btCollisionShape *chassis = new btBoxShape(btVector3(size.x, size.y, size.z));
+    btCompoundShape *shape = new btCompoundShape();
+    shape->addChildShape(localTrans, chassis);
+
+    btCollisionShape *shover = new btBoxShape(btVector3(size.x * 1.5f, size.y, 1.0f));
+    localTrans.setIdentity();
+    localTrans.setOrigin(btVector3(0.0f, size.y + 0.5f, size.z + 1.0f));
+    localTrans.setRotation(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w));
+    shape->addChildShape(localTrans, shover);
+
+    return insert(key, shape);
+}
+
+void CollisionShapeCache::AddRef(btCollisionShape *shape)
+{
+    auto found = _lookup.find(shape);
+    if (found == _lookup.end())
+    {
+        return;
+    }
+
+    found->second->second._refCount++;
+}
+
+void CollisionShapeCache::Release(btCollisionShape *shape)
+{
+    auto found = _lookup.find(shape);
+    if (found == _lookup.end())
+    {
+        return;
+    }
+
+    auto &entry = found->second->second;
+    if (entry._refCount > 0)
+    {
+        entry._refCount--;
+    }
+}
+
+int CollisionShapeCache::Purge()
+{
+    int count = 0;
+
+    for (auto itr = _shapes.begin(); itr != _shapes.end();)
+    {
+        if (itr->second._refCount > 0)
+        {
+            ++itr;
+            continue;
+        }
+
+        _lookup.erase(itr->second._shape);
+        deleteShape(itr->second._shape);
+        itr = _shapes.erase(itr);
+        count++;
+    }
+
+    return count;
+}
+
+int CollisionShapeCache::ShapeCount() const
+{
+    return int(_shapes.size());
+}
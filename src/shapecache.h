@@ -0,0 +1,71 @@
+#ifndef SHAPECACHE_H
+#define SHAPECACHE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <map>
+
+class btCollisionShape;
+
+// Hands out shared collision shapes, so every box of the same size uses the
+// same btBoxShape. Shapes are reference counted per body through AddRef() and
+// Release(). A shape stays alive when its count drops to 0, builders keep the
+// raw pointer and may build more bodies from it later. Unreferenced shapes are
+// deleted by Purge() or when the cache goes.
+class CollisionShapeCache
+{
+    enum class ShapeType
+    {
+        Box,
+        Sphere,
+        Capsule,
+        Cylinder,
+        Cone,
+        Car,
+    };
+
+    struct Key
+    {
+        ShapeType _type;
+        float _params[7];
+
+        bool operator<(Key const &other) const;
+    };
+
+    struct Entry
+    {
+        btCollisionShape *_shape;
+        int _refCount;
+    };
+
+    std::map<Key, Entry> _shapes;
+    std::map<btCollisionShape *, std::map<Key, Entry>::iterator> _lookup;
+
+    Key makeKey(ShapeType type, float p0 = 0.0f, float p1 = 0.0f, float p2 = 0.0f, float p3 = 0.0f, float p4 = 0.0f, float p5 = 0.0f, float p6 = 0.0f) const;
+    btCollisionShape *find(Key const &key) const;
+    btCollisionShape *insert(Key const &key, btCollisionShape *shape);
+    static void deleteShape(btCollisionShape *shape);
+
+public:
+    CollisionShapeCache();
+    virtual ~CollisionShapeCache();
+
+    btCollisionShape *Box(glm::vec3 const &size);
+    btCollisionShape *Sphere(float radius);
+    btCollisionShape *Capsule(float radius, float height, glm::vec3 const &centerOfMass);
+    btCollisionShape *Cylinder(glm::vec3 const &size);
+    btCollisionShape *Cone(float radius, float height);
+    btCollisionShape *Car(glm::vec3 const &size, glm::quat const &rotation);
+
+    // Call once for every body using the shape, and Release() when it is gone
+    void AddRef(btCollisionShape *shape);
+    void Release(btCollisionShape *shape);
+
+    // Deletes the shapes no body uses anymore, builders handing out one of
+    // them must not build again afterwards. Returns how many were deleted.
+    int Purge();
+
+    int ShapeCount() const;
+};
+
+#endif // SHAPECACHE_H